@@ -0,0 +1,52 @@
+TEMPLATE = app
+TARGET = LCVCFbench
+CONFIG += console c++11
+CONFIG -= app_bundle
+CONFIG -= qt
+QMAKE_CXXFLAGS += -std=c++11 -pthread
+LIBS += -lboost_iostreams
+LIBS += -lz
+LIBS += -lpthread
+INCLUDEPATH += ../src
+HEADERS += \
+    ../src/bcf.h \
+    ../src/bgzf.h \
+    ../src/cache.h \
+    ../src/config.h \
+    ../src/index.h \
+    ../src/kernels.h \
+    ../src/lcvcftools.h \
+    ../src/linereader.h \
+    ../src/metrics.h \
+    ../src/scan.h \
+    ../src/stats.h \
+    vcfgen.h
+SOURCES += \
+    ../src/allocation.cpp \
+    ../src/bcf.cpp \
+    ../src/bgzf.cpp \
+    ../src/cache.cpp \
+    ../src/checkpoint.cpp \
+    ../src/cli.cpp \
+    ../src/filter.cpp \
+    ../src/index.cpp \
+    ../src/input.cpp \
+    ../src/kernels.cpp \
+    ../src/lcvcftools.cpp \
+    ../src/linereader.cpp \
+    ../src/list.cpp \
+    ../src/metrics.cpp \
+    ../src/output.cpp \
+    ../src/record.cpp \
+    ../src/scan.cpp \
+    ../src/split.cpp \
+    ../src/stats.cpp \
+    bench.cpp \
+    vcfgen.cpp
+CONFIG(debug, debug|release) {
+    OBJECTS_DIR = build/debug
+    DEFINES += LCVCF_CHECK_ALLOCATIONS
+}
+CONFIG(release, debug|release) {
+    OBJECTS_DIR = build/release
+}
@@ -0,0 +1,291 @@
+#include "lcvcftools.h"
+#include "vcfgen.h"
+#include <boost/iostreams/device/file.hpp>
+#include <sys/stat.h>
+/*************
+    Benchmarks for LCVCFtools: generates synthetic inputs, times
+    StringToVcf/Filter/OutputLine/CheckRate on one worker and whole
+    runs on plain, gzip and BGZF input, and writes the results as JSON.
+*************/
+class LCVCFbench
+{
+public:
+    LCVCFbench(int argc, char* argv[]);
+    void Run();
+private:
+    typedef std::chrono::steady_clock Clock;
+    struct ResultStruct{
+        std::string Name;
+        size_t Calls = 0;
+        double Seconds = 0;
+        uint64_t InputBytes = 0, VcfBytes = 0;
+    };
+    /*************
+        FUNCTIONS
+    *************/
+    void SetParameters(std::vector<std::string>& args);
+    void ShowHelp();
+    void Generate(const std::string& Filename);
+    void RunMicro(const std::string& Filename);
+    void RunEndToEnd(const std::string& Name, const std::string& Mode, const std::string& Filename);
+    std::string Json();
+    static double Elapsed(Clock::time_point Begin, Clock::time_point End);
+    static uint64_t FileSize(const std::string& Filename);
+    /*************
+        PARAMETERS
+    *************/
+    VcfGenerator::OptionsStruct Options;
+    size_t Repeat = 3, Threads = 1;
+    std::string Directory = "/tmp", OutputFilename, GenerateFilename;
+    bool IsKeepFiles = false;
+    /*************
+        RESULTS
+    *************/
+    std::vector<ResultStruct> Micro, EndToEnd;
+    uint64_t VcfBytes = 0;
+};
+LCVCFbench::LCVCFbench(int argc, char* argv[]){
+    std::vector<std::string> args;
+    for(int i(1); i < argc; i++) args.push_back(std::string(argv[i]));
+    SetParameters(args);
+}
+void LCVCFbench::ShowHelp(){
+    std::clog << "LCVCFbench, benchmarks for LCVCFtools Version " << THIS_VERSION << "\n"
+                 "\n"
+                 "--samples <INT>         Number of samples. [Default=200]\n"
+                 "--sites   <INT>         Number of variants. [Default=20000]\n"
+                 "--layouts <STRING>      FORMAT layouts separated by ',', picked at random per variant. [Default=GT:AD:DP:GQ:PL]\n"
+                 "--missing <FLOAT>       Fraction of missing (DP=0) genotypes. [Default=0.1]\n"
+                 "--multiallelic <FLOAT>  Fraction of variants with two ALT alleles. [Default=0.05]\n"
+                 "--depth   <FLOAT>       Mean depth. [Default=8]\n"
+                 "--dispersion <FLOAT>    Negative binomial dispersion of depth, 0 for Poisson. [Default=0]\n"
+                 "--seed    <INT>         Random seed. [Default=1]\n"
+                 "--repeat  <INT>         Runs per benchmark, the fastest one is reported. [Default=3]\n"
+                 "--threads <INT>         Threads for the end-to-end runs. [Default=1]\n"
+                 "--dir     <STRING>      Directory for the generated inputs. [Default=/tmp]\n"
+                 "--keep-files            Don't remove the generated inputs.\n"
+                 "--out     <STRING>      Write the JSON results to a file instead of stdout.\n"
+                 "--generate <STRING>     Only write a synthetic VCF (.gz as gzip, .bgz as BGZF) and exit.\n"
+                 "--help                  Print this message.\n"
+              << std::endl;
+}
+void LCVCFbench::SetParameters(std::vector<std::string>& args){
+    for(size_t i(0); i < args.size(); i++){
+        if(args[i]=="--help"){
+            ShowHelp();
+            throw 0;
+        }
+        if(args[i]=="--keep-files"){
+            IsKeepFiles = true;
+            continue;
+        }
+        if(i+1 >= args.size()) throw std::runtime_error("Missing argument value for " + args[i]);
+        const std::string& Value = args[++i];
+        if(args[i-1]=="--samples") Options.Samples = std::stoul(Value);
+        else if(args[i-1]=="--sites") Options.Sites = std::stoul(Value);
+        else if(args[i-1]=="--layouts") boost::split(Options.Layouts, Value, boost::algorithm::is_any_of(","));
+        else if(args[i-1]=="--missing") Options.Missing = std::stod(Value);
+        else if(args[i-1]=="--multiallelic") Options.Multiallelic = std::stod(Value);
+        else if(args[i-1]=="--depth") Options.Depth = std::stod(Value);
+        else if(args[i-1]=="--dispersion") Options.Dispersion = std::stod(Value);
+        else if(args[i-1]=="--seed") Options.Seed = std::stoull(Value);
+        else if(args[i-1]=="--repeat") Repeat = std::max<size_t>(1, std::stoul(Value));
+        else if(args[i-1]=="--threads") Threads = std::max<size_t>(1, std::stoul(Value));
+        else if(args[i-1]=="--dir") Directory = Value;
+        else if(args[i-1]=="--out") OutputFilename = Value;
+        else if(args[i-1]=="--generate") GenerateFilename = Value;
+        else throw std::runtime_error(args[i-1] + " is an invalid argument");
+    }
+    if(Options.Samples==0 || Options.Sites==0) throw std::runtime_error("samples and sites must be greater than 0");
+}
+double LCVCFbench::Elapsed(Clock::time_point Begin, Clock::time_point End){
+    return std::chrono::duration<double>(End - Begin).count();
+}
+uint64_t LCVCFbench::FileSize(const std::string& Filename){
+    struct stat Info;
+    return stat(Filename.c_str(), &Info)==0 ? Info.st_size : 0;
+}
+void LCVCFbench::Generate(const std::string& Filename){
+    VcfGenerator Generator(Options);
+    std::string Line = Generator.Header();
+    size_t Dot = Filename.find_last_of('.');
+    std::string Extension = Dot==std::string::npos ? "" : Filename.substr(Dot);
+    if(Extension==".bgz"){
+        BgzfWriter Writer(Filename, Threads);
+        if(!Writer.IsOpen()) throw std::runtime_error("Can't write " + Filename);
+        Writer.Write(Line.data(), Line.size());
+        for(size_t i(0); i < Options.Sites; i++){
+            Generator.Record(i, Line);
+            Writer.Write(Line.data(), Line.size());
+        }
+        Writer.Close();
+        return;
+    }
+    std::ofstream File(Filename, std::ios_base::out | std::ios_base::binary);
+    if(!File.is_open()) throw std::runtime_error("Can't write " + Filename);
+    boost::iostreams::filtering_ostream Out;
+    if(Extension==".gz") Out.push(boost::iostreams::gzip_compressor());
+    Out.push(File);
+    Out << Line;
+    for(size_t i(0); i < Options.Sites; i++){
+        Generator.Record(i, Line);
+        Out << Line;
+    }
+    Out.reset();
+    File.close();
+    if(!File) throw std::runtime_error("Failed to write " + Filename);
+}
+void LCVCFbench::RunMicro(const std::string& Filename){
+    /*************
+        One tool instance reads the header and records, then every
+        record goes through the worker functions with each call timed
+    *************/
+    std::vector<std::string> Args = {"LCVCFbench", "--vcf", Filename, "--out", "/dev/null"};
+    std::vector<char*> Argv;
+    for(std::string& Arg : Args) Argv.push_back(&Arg[0]);
+    LCVCFtools Tool(Argv.size(), Argv.data());
+    Tool.StartStages();
+    std::vector<std::string> Lines;
+    std::string Line;
+    while(Tool.ReadStageLine(Line)) Lines.push_back(Line);
+    ResultStruct Parse, Filter, Output, Rate;
+    Parse.Name = "StringToVcf";
+    Filter.Name = "Filter";
+    Output.Name = "OutputLine";
+    Rate.Name = "CheckRate";
+    for(size_t r(0); r < Repeat; r++){
+        ResultStruct tmpParse, tmpFilter, tmpOutput;
+        for(const std::string& Record : Lines){
+            Clock::time_point t0 = Clock::now();
+            Tool.ParseStage(Record);
+            Clock::time_point t1 = Clock::now();
+            bool IsPassed = Tool.FilterStage();
+            Clock::time_point t2 = Clock::now();
+            tmpParse.Seconds += Elapsed(t0, t1);
+            tmpFilter.Seconds += Elapsed(t1, t2);
+            tmpParse.Calls++;
+            tmpFilter.Calls++;
+            if(!IsPassed) continue;
+            Tool.OutputStage();
+            Clock::time_point t3 = Clock::now();
+            tmpOutput.Seconds += Elapsed(t2, t3);
+            tmpOutput.Calls++;
+        }
+        if(!r || tmpParse.Seconds < Parse.Seconds) Parse.Seconds = tmpParse.Seconds, Parse.Calls = tmpParse.Calls;
+        if(!r || tmpFilter.Seconds < Filter.Seconds) Filter.Seconds = tmpFilter.Seconds, Filter.Calls = tmpFilter.Calls;
+        if(!r || tmpOutput.Seconds < Output.Seconds) Output.Seconds = tmpOutput.Seconds, Output.Calls = tmpOutput.Calls;
+    }
+    /*************
+        CheckRate over one DP vector per variant
+    *************/
+    std::mt19937_64 Random(Options.Seed);
+    std::poisson_distribution<int> Poisson(Options.Depth);
+    std::vector<int> Depths(Options.Samples);
+    for(int& DP : Depths) DP = Poisson(Random);
+    size_t Rejected = 0;
+    for(size_t r(0); r < Repeat; r++){
+        Clock::time_point t0 = Clock::now();
+        for(size_t i(0); i < Lines.size(); i++) Rejected += Tool.RateStage(Depths, FilterConfig().minDP + int(i%3), 0.5);
+        double Seconds = Elapsed(t0, Clock::now());
+        if(!r || Seconds < Rate.Seconds) Rate.Seconds = Seconds;
+        Rate.Calls = Lines.size();
+    }
+    if(Rejected==size_t(-1)) std::clog << Rejected;
+    Micro = {Parse, Filter, Output, Rate};
+}
+void LCVCFbench::RunEndToEnd(const std::string& Name, const std::string& Mode, const std::string& Filename){
+    ResultStruct Result;
+    Result.Name = Name;
+    Result.InputBytes = FileSize(Filename);
+    Result.VcfBytes = VcfBytes;
+    Result.Calls = Options.Sites;
+    for(size_t r(0); r < Repeat; r++){
+        std::vector<std::string> Args = {"LCVCFbench", Mode, Filename, "--out", "/dev/null", "--threads", std::to_string(Threads)};
+        std::vector<char*> Argv;
+        for(std::string& Arg : Args) Argv.push_back(&Arg[0]);
+        Clock::time_point t0 = Clock::now();
+        LCVCFtools Tool(Argv.size(), Argv.data());
+        Tool.Run();
+        double Seconds = Elapsed(t0, Clock::now());
+        if(!r || Seconds < Result.Seconds) Result.Seconds = Seconds;
+    }
+    EndToEnd.push_back(Result);
+}
+std::string LCVCFbench::Json(){
+    auto Quote = [](const std::string& String){
+        std::string tmpString = "\"";
+        for(char c : String){
+            if(c=='"' || c=='\\') tmpString += '\\';
+            tmpString += c;
+        }
+        return tmpString + '"';
+    };
+    std::ostringstream sso;
+    sso << std::setprecision(6);
+    sso << "{\n"
+        << "  \"version\": " << Quote(THIS_VERSION) << ",\n"
+        << "  \"parameters\": {\"samples\": " << Options.Samples << ", \"sites\": " << Options.Sites << ", \"layouts\": [";
+    for(size_t i(0); i < Options.Layouts.size(); i++) sso << (i ? ", " : "") << Quote(Options.Layouts[i]);
+    sso << "], \"missing\": " << Options.Missing << ", \"multiallelic\": " << Options.Multiallelic
+        << ", \"depth\": " << Options.Depth << ", \"dispersion\": " << Options.Dispersion
+        << ", \"seed\": " << Options.Seed << ", \"repeat\": " << Repeat << ", \"threads\": " << Threads << "},\n"
+        << "  \"microbenchmarks\": [\n";
+    for(size_t i(0); i < Micro.size(); i++){
+        const ResultStruct& R = Micro[i];
+        sso << "    {\"name\": " << Quote(R.Name) << ", \"calls\": " << R.Calls << ", \"seconds\": " << R.Seconds
+            << ", \"ns_per_call\": " << (R.Calls ? R.Seconds*1e9/R.Calls : 0)
+            << ", \"calls_per_s\": " << (R.Seconds > 0 ? R.Calls/R.Seconds : 0) << "}" << (i+1 < Micro.size() ? "," : "") << "\n";
+    }
+    sso << "  ],\n"
+        << "  \"end_to_end\": [\n";
+    for(size_t i(0); i < EndToEnd.size(); i++){
+        const ResultStruct& R = EndToEnd[i];
+        sso << "    {\"input\": " << Quote(R.Name) << ", \"input_bytes\": " << R.InputBytes << ", \"vcf_bytes\": " << R.VcfBytes
+            << ", \"sites\": " << R.Calls << ", \"seconds\": " << R.Seconds
+            << ", \"mb_per_s\": " << (R.Seconds > 0 ? R.VcfBytes/1e6/R.Seconds : 0)
+            << ", \"sites_per_s\": " << (R.Seconds > 0 ? R.Calls/R.Seconds : 0) << "}" << (i+1 < EndToEnd.size() ? "," : "") << "\n";
+    }
+    sso << "  ]\n"
+        << "}\n";
+    return sso.str();
+}
+void LCVCFbench::Run(){
+    if(!GenerateFilename.empty()){
+        Generate(GenerateFilename);
+        return;
+    }
+    std::string Prefix = Directory + "/LCVCFbench_" + std::to_string(getpid());
+    std::vector<std::string> Files = {Prefix + ".vcf", Prefix + ".vcf.gz", Prefix + ".vcf.bgz"};
+    try{
+        for(const std::string& Filename : Files) Generate(Filename);
+        VcfBytes = FileSize(Files[0]);
+        RunMicro(Files[0]);
+        RunEndToEnd("plain", "--vcf", Files[0]);
+        RunEndToEnd("gzip", "--gzvcf", Files[1]);
+        RunEndToEnd("bgzf", "--gzvcf", Files[2]);
+    }
+    catch(...){
+        if(!IsKeepFiles) for(const std::string& Filename : Files) std::remove(Filename.c_str());
+        throw;
+    }
+    if(!IsKeepFiles) for(const std::string& Filename : Files) std::remove(Filename.c_str());
+    if(OutputFilename.empty()){
+        std::cout << Json();
+        return;
+    }
+    std::ofstream File(OutputFilename);
+    File << Json();
+    if(!File) throw std::runtime_error("Can't write " + OutputFilename);
+}
+int main(int argc, char* argv[]){
+    try{
+        LCVCFbench a(argc, argv);
+        a.Run();
+    }
+    catch(int i){return i;}
+    catch(const std::exception& e){
+        std::clog << "**ERROR** " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "vcfgen.h"
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+VcfGenerator::VcfGenerator(const OptionsStruct& Options) : Options(Options){
+    for(const std::string& FORMATstr : Options.Layouts){
+        LayoutStruct Layout;
+        Layout.FORMATstr = FORMATstr;
+        std::vector<std::string> Tags;
+        boost::split(Tags, FORMATstr, boost::algorithm::is_any_of(":"));
+        const char* Known[] = {"GT", "AD", "DP", "GQ", "PL"};
+        for(const std::string& Tag : Tags)
+            Layout.Tags.push_back(std::find(Known, Known+5, Tag) - Known);
+        for(int i(0); i < TAG_OTHER; i++)
+            if(std::find(Layout.Tags.begin(), Layout.Tags.end(), i)==Layout.Tags.end())
+                throw std::runtime_error("FORMAT layout " + FORMATstr + " lacks " + Known[i]);
+        Layouts.push_back(Layout);
+    }
+    if(Layouts.empty()) throw std::runtime_error("No FORMAT layout");
+}
+std::string VcfGenerator::Header(){
+    std::string Header = "##fileformat=VCFv4.2\n"
+                         "##source=LCVCFbench\n"
+                         "##contig=<ID=1,length=" + std::to_string(1000 + Options.Sites*100) + ">\n"
+                         "##INFO=<ID=DP,Number=1,Type=Integer,Description=\"Total depth\">\n"
+                         "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n"
+                         "##FORMAT=<ID=AD,Number=R,Type=Integer,Description=\"Allelic depths\">\n"
+                         "##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"Read depth\">\n"
+                         "##FORMAT=<ID=GQ,Number=1,Type=Integer,Description=\"Genotype quality\">\n"
+                         "##FORMAT=<ID=PL,Number=G,Type=Integer,Description=\"Phred-scaled likelihoods\">\n"
+                         "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT";
+    for(size_t i(0); i < Options.Samples; i++) Header += "\tS" + std::to_string(i);
+    return Header + '\n';
+}
+int VcfGenerator::SampleDepth(std::mt19937_64& Random){
+    double Mean = Options.Depth;
+    if(Options.Dispersion > 0){
+        std::gamma_distribution<double> Gamma(Options.Dispersion, Options.Depth/Options.Dispersion);
+        Mean = Gamma(Random);
+    }
+    std::poisson_distribution<int> Poisson(Mean);
+    return Mean > 0 ? Poisson(Random) : 0;
+}
+void VcfGenerator::Record(size_t Site, std::string& Line){
+    /*************
+        Each site has its own generator, records can be made in any
+        order and still match
+    *************/
+    std::mt19937_64 Random(Options.Seed*0x9E3779B97F4A7C15ULL + Site);
+    std::uniform_real_distribution<double> Uniform(0, 1);
+    const char Bases[] = "ACGT";
+    int Ref = Random() % 4;
+    size_t nAlleles = Uniform(Random) < Options.Multiallelic ? 3 : 2;
+    std::string ALT;
+    for(size_t i(1); i < nAlleles; i++){
+        if(i > 1) ALT += ',';
+        ALT += Bases[(Ref+i) % 4];
+    }
+    const LayoutStruct& Layout = Layouts[Random() % Layouts.size()];
+    std::vector<double> Frequency(nAlleles);
+    for(size_t i(0); i < nAlleles; i++) Frequency[i] = i ? Uniform(Random)*0.5 + 0.02 : 1;
+    std::discrete_distribution<int> Allele(Frequency.begin(), Frequency.end());
+    std::string Samples;
+    std::vector<int> AD(nAlleles), PL(nAlleles*(nAlleles+1)/2);
+    const double ReadScore[] = {-10*std::log10(0.01/3), -10*std::log10(0.5*0.99 + 0.01/3), -10*std::log10(0.99 + 0.01/3)};
+    long DepthSum = 0;
+    for(size_t k(0); k < Options.Samples; k++){
+        int DP = Uniform(Random) < Options.Missing ? 0 : SampleDepth(Random);
+        int A = Allele(Random), B = Allele(Random);
+        if(A > B) std::swap(A, B);
+        std::fill(AD.begin(), AD.end(), 0);
+        for(int r(0); r < DP; r++){
+            double x = Uniform(Random);
+            if(x < 0.01) AD[Random() % nAlleles]++;
+            else AD[x < 0.505 ? A : B]++;
+        }
+        DepthSum += DP;
+        /*************
+            PL from read counts with a 1% error rate
+        *************/
+        double Best = 1e300;
+        std::vector<double> Score(PL.size());
+        for(size_t b(0), g(0); b < nAlleles; b++){
+            for(size_t a(0); a <= b; a++, g++){
+                for(size_t x(0); x < nAlleles; x++) Score[g] += AD[x] * ReadScore[(x==a) + (x==b)];
+                Best = std::min(Best, Score[g]);
+            }
+        }
+        int GQ = 99;
+        for(size_t g(0); g < PL.size(); g++){
+            PL[g] = std::lround(Score[g] - Best);
+            if(PL[g] > 0) GQ = std::min(GQ, PL[g]);
+        }
+        if(DP==0) GQ = 0;
+        if(k) Samples += '\t';
+        for(size_t t(0); t < Layout.Tags.size(); t++){
+            if(t) Samples += ':';
+            switch(Layout.Tags[t]){
+            case TAG_GT:
+                if(DP==0) Samples += "./.";
+                else Samples += std::to_string(A) + '/' + std::to_string(B);
+                break;
+            case TAG_AD:
+                for(size_t i(0); i < nAlleles; i++) Samples += (i ? "," : "") + std::to_string(AD[i]);
+                break;
+            case TAG_DP:
+                Samples += std::to_string(DP);
+                break;
+            case TAG_GQ:
+                Samples += std::to_string(GQ);
+                break;
+            case TAG_PL:
+                for(size_t g(0); g < PL.size(); g++) Samples += (g ? "," : "") + std::to_string(DP ? PL[g] : 0);
+                break;
+            default:
+                Samples += '.';
+            }
+        }
+    }
+    Line = "1\t" + std::to_string(1000 + Site*100) + "\t.\t" + Bases[Ref] + '\t' + ALT +
+           "\t50\tPASS\tDP=" + std::to_string(DepthSum) + '\t' + Layout.FORMATstr + '\t' + Samples + '\n';
+}
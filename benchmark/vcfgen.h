@@ -0,0 +1,35 @@
+#ifndef VCFGEN_H
+#define VCFGEN_H
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+/*************
+    Deterministic synthetic VCF: the same options and seed always give
+    the same file. Depths follow a Poisson (Dispersion=0) or negative
+    binomial distribution, AD/PL/GQ are derived from the sampled reads.
+*************/
+class VcfGenerator
+{
+public:
+    struct OptionsStruct{
+        size_t Samples = 200, Sites = 20000;
+        std::vector<std::string> Layouts = {"GT:AD:DP:GQ:PL"};
+        double Missing = 0.1, Multiallelic = 0.05;
+        double Depth = 8, Dispersion = 0;
+        uint64_t Seed = 1;
+    };
+    VcfGenerator(const OptionsStruct& Options);
+    std::string Header();
+    void Record(size_t Site, std::string& Line);
+private:
+    struct LayoutStruct{
+        std::string FORMATstr;
+        std::vector<int> Tags;
+    };
+    enum TagEnum {TAG_GT, TAG_AD, TAG_DP, TAG_GQ, TAG_PL, TAG_OTHER};
+    int SampleDepth(std::mt19937_64& Random);
+    OptionsStruct Options;
+    std::vector<LayoutStruct> Layouts;
+};
+#endif
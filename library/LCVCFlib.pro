@@ -0,0 +1,55 @@
+TEMPLATE = lib
+TARGET = LCVCF
+CONFIG += c++11
+CONFIG -= qt
+# Static by default, "qmake CONFIG+=lcvcf_shared" builds the shared library
+!lcvcf_shared: CONFIG += staticlib
+QMAKE_CXXFLAGS += -std=c++11 -pthread
+LIBS += -lboost_iostreams
+LIBS += -lz
+LIBS += -lpthread
+INCLUDEPATH += ../src
+HEADERS += \
+    ../src/bcf.h \
+    ../src/bgzf.h \
+    ../src/cache.h \
+    ../src/config.h \
+    ../src/index.h \
+    ../src/kernels.h \
+    ../src/lcvcflib.h \
+    ../src/lcvcftools.h \
+    ../src/linereader.h \
+    ../src/metrics.h \
+    ../src/scan.h \
+    ../src/stats.h
+SOURCES += \
+    ../src/bcf.cpp \
+    ../src/bgzf.cpp \
+    ../src/cache.cpp \
+    ../src/checkpoint.cpp \
+    ../src/filter.cpp \
+    ../src/index.cpp \
+    ../src/input.cpp \
+    ../src/kernels.cpp \
+    ../src/lcvcflib.cpp \
+    ../src/lcvcftools.cpp \
+    ../src/linereader.cpp \
+    ../src/list.cpp \
+    ../src/metrics.cpp \
+    ../src/output.cpp \
+    ../src/record.cpp \
+    ../src/scan.cpp \
+    ../src/split.cpp \
+    ../src/stats.cpp
+# Only the interface headers are installed, the engine headers stay private
+isEmpty(PREFIX): PREFIX = /usr/local
+target.path = $$PREFIX/lib
+headers.path = $$PREFIX/include/LCVCF
+headers.files = ../src/config.h ../src/lcvcflib.h
+INSTALLS += target headers
+CONFIG(debug, debug|release) {
+    OBJECTS_DIR = build/debug
+}
+CONFIG(release, debug|release) {
+    OBJECTS_DIR = build/release
+}
@@ -0,0 +1,39 @@
+#include "metrics.h"
+#include <new>
+#include <cstdlib>
+/*************
+    Global operator new/delete feeding AllocationCounter. Only the
+    programs link this file, the library keeps the host's allocator.
+*************/
+static void* Allocate(std::size_t Size){
+    AllocationCounter::Add(Size);
+    return std::malloc(Size ? Size : 1);
+}
+void* operator new(std::size_t Size){
+    void* p = Allocate(Size);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](std::size_t Size){
+    void* p = Allocate(Size);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new(std::size_t Size, const std::nothrow_t&) noexcept{
+    return Allocate(Size);
+}
+void* operator new[](std::size_t Size, const std::nothrow_t&) noexcept{
+    return Allocate(Size);
+}
+void operator delete(void* p) noexcept{
+    std::free(p);
+}
+void operator delete[](void* p) noexcept{
+    std::free(p);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept{
+    std::free(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept{
+    std::free(p);
+}
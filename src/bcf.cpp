@@ -0,0 +1,184 @@
+#include "bcf.h"
+#include <stdexcept>
+#include <algorithm>
+std::map<std::string,std::string> BcfDecoder::ReadStructuredLine(const std::string& Line){
+    std::map<std::string,std::string> Fields;
+    size_t i = Line.find('<');
+    if(i==std::string::npos) return Fields;
+    while(++i < Line.size() && Line[i]!='>'){
+        size_t Eq = Line.find('=', i);
+        if(Eq==std::string::npos) break;
+        std::string Key = Line.substr(i, Eq-i), Value;
+        i = Eq+1;
+        if(i < Line.size() && Line[i]=='"'){
+            while(++i < Line.size() && Line[i]!='"'){
+                if(Line[i]=='\\' && i+1 < Line.size()) i++;
+                Value += Line[i];
+            }
+            i++;
+        }
+        else{
+            while(i < Line.size() && Line[i]!=',' && Line[i]!='>') Value += Line[i++];
+        }
+        Fields[Key] = Value;
+        if(i >= Line.size() || Line[i]=='>') break;
+    }
+    return Fields;
+}
+void BcfDecoder::ReadHeaderText(const std::string& Text){
+    /*************
+        FILTER/INFO/FORMAT share one dictionary with PASS at 0,
+        IDX= overrides the implicit order
+    *************/
+    Strings.assign(1, "PASS");
+    Contigs.clear();
+    size_t Begin = 0;
+    while(Begin < Text.size()){
+        size_t End = Text.find('\n', Begin);
+        if(End==std::string::npos) End = Text.size();
+        std::string Line = Text.substr(Begin, End-Begin);
+        Begin = End+1;
+        bool IsString = Line.compare(0, 10, "##FILTER=<")==0 ||
+                        Line.compare(0, 8, "##INFO=<")==0 ||
+                        Line.compare(0, 10, "##FORMAT=<")==0;
+        bool IsContig = Line.compare(0, 10, "##contig=<")==0;
+        if(!IsString && !IsContig) continue;
+        std::map<std::string,std::string> Fields = ReadStructuredLine(Line);
+        if(Fields.find("ID")==Fields.end()) continue;
+        std::vector<std::string>& Dictionary = IsString ? Strings : Contigs;
+        const std::string& Id = Fields["ID"];
+        if(Fields.find("IDX")!=Fields.end()){
+            size_t Idx = std::stoul(Fields["IDX"]);
+            if(Dictionary.size() <= Idx) Dictionary.resize(Idx+1);
+            Dictionary[Idx] = Id;
+        }
+        else if(std::find(Dictionary.begin(), Dictionary.end(), Id)==Dictionary.end())
+            Dictionary.push_back(Id);
+    }
+}
+size_t BcfDecoder::TypeSize(int Type){
+    switch(Type){
+    case BT_NULL:  return 0;
+    case BT_INT8:  return 1;
+    case BT_INT16: return 2;
+    case BT_INT32: return 4;
+    case BT_FLOAT: return 4;
+    case BT_CHAR:  return 1;
+    }
+    throw std::runtime_error("Invalid BCF type " + std::to_string(Type));
+}
+const char* BcfDecoder::ReadDescriptor(const char* p, const char* End, TypedStruct& Value){
+    if(p >= End) throw std::runtime_error("Truncated BCF record");
+    unsigned char Descriptor = *p++;
+    Value.Type = Descriptor & 0x0F;
+    Value.Count = Descriptor >> 4;
+    if(Value.Count==15){
+        TypedStruct Size;
+        p = ReadTyped(p, End, Size);
+        if(Size.Count!=1 || Size.Type==BT_FLOAT || Size.Type==BT_CHAR)
+            throw std::runtime_error("Invalid BCF vector size");
+        Value.Count = GetInt(Size.Type, Size.Data, 0);
+    }
+    Value.Data = p;
+    return p;
+}
+const char* BcfDecoder::ReadTyped(const char* p, const char* End, TypedStruct& Value){
+    p = ReadDescriptor(p, End, Value);
+    p += Value.Count*TypeSize(Value.Type);
+    if(p > End) throw std::runtime_error("Truncated BCF record");
+    return p;
+}
+int32_t BcfDecoder::GetInt(int Type, const char* p, size_t i){
+    switch(Type){
+    case BT_INT8:{
+        int8_t v = static_cast<int8_t>(p[i]);
+        if(v==INT8_MIN) return IntMissing;
+        if(v==INT8_MIN+1) return IntVectorEnd;
+        return v;
+    }
+    case BT_INT16:{
+        int16_t v;
+        std::memcpy(&v, p+2*i, 2);
+        if(v==INT16_MIN) return IntMissing;
+        if(v==INT16_MIN+1) return IntVectorEnd;
+        return v;
+    }
+    case BT_INT32:{
+        int32_t v;
+        std::memcpy(&v, p+4*i, 4);
+        return v;
+    }
+    }
+    throw std::runtime_error("BCF value is not an integer");
+}
+bool BcfDecoder::IsFloatMissing(float Value){
+    uint32_t Bits;
+    std::memcpy(&Bits, &Value, 4);
+    return Bits==0x7F800001;
+}
+bool BcfDecoder::IsFloatVectorEnd(float Value){
+    uint32_t Bits;
+    std::memcpy(&Bits, &Value, 4);
+    return Bits==0x7F800002;
+}
+size_t BcfDecoder::CountValues(int Type, const char* p, size_t Count){
+    if(Type==BT_CHAR) return Count ? 1 : 0;
+    for(size_t i(0); i < Count; i++){
+        if(Type==BT_FLOAT){
+            float v;
+            std::memcpy(&v, p+4*i, 4);
+            if(IsFloatVectorEnd(v)) return i;
+        }
+        else if(GetInt(Type, p, i)==IntVectorEnd) return i;
+    }
+    return Count;
+}
+void BcfDecoder::AppendFloat(std::string& Out, float Value){
+    if(IsFloatMissing(Value)){
+        Out += '.';
+        return;
+    }
+    char Buffer[32];
+    int n = std::snprintf(Buffer, sizeof(Buffer), "%g", Value);
+    Out.append(Buffer, n);
+}
+void BcfDecoder::AppendValues(std::string& Out, int Type, const char* p, size_t Count){
+    if(Type==BT_CHAR){
+        size_t n = 0;
+        while(n < Count && p[n]) n++;
+        if(n) Out.append(p, n);
+        else Out += '.';
+        return;
+    }
+    size_t n = CountValues(Type, p, Count);
+    if(n==0){
+        Out += '.';
+        return;
+    }
+    for(size_t i(0); i < n; i++){
+        if(i) Out += ',';
+        if(Type==BT_FLOAT){
+            float v;
+            std::memcpy(&v, p+4*i, 4);
+            AppendFloat(Out, v);
+        }
+        else{
+            int32_t v = GetInt(Type, p, i);
+            if(v==IntMissing) Out += '.';
+            else Out += std::to_string(v);
+        }
+    }
+}
+void BcfDecoder::AppendGenotype(std::string& Out, int Type, const char* p, size_t Count){
+    size_t n = CountValues(Type, p, Count);
+    if(n==0){
+        Out += '.';
+        return;
+    }
+    for(size_t i(0); i < n; i++){
+        int32_t v = GetInt(Type, p, i);
+        if(i) Out += (v & 1) ? '|' : '/';
+        if(v==IntMissing || (v >> 1)==0) Out += '.';
+        else Out += std::to_string((v >> 1) - 1);
+    }
+}
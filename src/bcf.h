@@ -0,0 +1,44 @@
+#ifndef BCF_H
+#define BCF_H
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+/*************
+    BCF2 typed values and header dictionaries.
+    Records are little-endian and unaligned, values are read with memcpy.
+*************/
+class BcfDecoder
+{
+public:
+    static const int BT_NULL  = 0;
+    static const int BT_INT8  = 1;
+    static const int BT_INT16 = 2;
+    static const int BT_INT32 = 3;
+    static const int BT_FLOAT = 5;
+    static const int BT_CHAR  = 7;
+    static const int32_t IntMissing   = INT32_MIN;
+    static const int32_t IntVectorEnd = INT32_MIN+1;
+    struct TypedStruct{
+        int Type = BT_NULL;
+        size_t Count = 0;
+        const char* Data = nullptr;
+    };
+    std::vector<std::string> Strings, Contigs;
+    void ReadHeaderText(const std::string& Text);
+    static size_t TypeSize(int Type);
+    static const char* ReadDescriptor(const char* p, const char* End, TypedStruct& Value);
+    static const char* ReadTyped(const char* p, const char* End, TypedStruct& Value);
+    static int32_t GetInt(int Type, const char* p, size_t i);
+    static size_t CountValues(int Type, const char* p, size_t Count);
+    static void AppendValues(std::string& Out, int Type, const char* p, size_t Count);
+    static void AppendGenotype(std::string& Out, int Type, const char* p, size_t Count);
+    static void AppendFloat(std::string& Out, float Value);
+    static bool IsFloatMissing(float Value);
+private:
+    static bool IsFloatVectorEnd(float Value);
+    static std::map<std::string,std::string> ReadStructuredLine(const std::string& Line);
+};
+#endif
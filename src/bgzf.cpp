@@ -0,0 +1,439 @@
+#include "bgzf.h"
+#include <unistd.h>
+BgzfReader::BgzfReader(std::istream& Stream, size_t Threads, const std::string& Prefix) :
+    Stream(Stream), Prefix(Prefix){
+    if(Threads < 1) Threads = 1;
+    ReadAhead = 4*Threads;
+    for(size_t i(0); i < Threads; i++) Workers.emplace_back(&BgzfReader::WorkerThread, this);
+}
+BgzfReader::~BgzfReader(){
+    Stop();
+}
+bool BgzfReader::IsBgzf(const char* Header, size_t Size){
+    if(Size < HeaderSize) return false;
+    const unsigned char* h = reinterpret_cast<const unsigned char*>(Header);
+    return h[0]==31 && h[1]==139 && h[2]==8 && (h[3]&4) && h[12]=='B' && h[13]=='C' && h[14]==2 && h[15]==0;
+}
+void BgzfReader::Stop(){
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        IsClosed = true;
+        WorkQueue.clear();
+    }
+    WorkCV.notify_all();
+    for(std::thread& T : Workers) if(T.joinable()) T.join();
+}
+size_t BgzfReader::ReadBytes(char* Buffer, size_t Size){
+    size_t n = 0;
+    if(PrefixPos < Prefix.size()){
+        n = std::min(Size, Prefix.size()-PrefixPos);
+        std::memcpy(Buffer, Prefix.data()+PrefixPos, n);
+        PrefixPos += n;
+    }
+    if(n < Size){
+        Stream.read(Buffer+n, Size-n);
+        n += Stream.gcount();
+    }
+    CompressedOffset += n;
+    return n;
+}
+bool BgzfReader::ReadBlock(BlockStruct& Block){
+    char Header[HeaderSize];
+    Block.Offset = CompressedOffset;
+    size_t n = ReadBytes(Header, HeaderSize);
+    if(n==0) return false;
+    if(!IsBgzf(Header, n)) throw std::runtime_error("Invalid BGZF block header at offset " + std::to_string(Block.Offset));
+    const unsigned char* h = reinterpret_cast<const unsigned char*>(Header);
+    size_t XLEN = h[10] | (h[11] << 8);
+    size_t BSIZE = h[16] | (h[17] << 8);
+    if(XLEN < 6 || BSIZE+1 < 12+XLEN+8) throw std::runtime_error("Invalid BGZF block size at offset " + std::to_string(Block.Offset));
+    /*************
+        Skip extra subfields after BC, keep deflate data + CRC32 + ISIZE
+    *************/
+    Block.Compressed.resize(BSIZE+1-HeaderSize);
+    if(ReadBytes(&Block.Compressed[0], Block.Compressed.size())!=Block.Compressed.size())
+        throw std::runtime_error("Truncated BGZF block at offset " + std::to_string(Block.Offset));
+    Block.Compressed.erase(0, XLEN-6);
+    Block.NextOffset = CompressedOffset;
+    Block.IsDone = false;
+    Block.Error.clear();
+    return true;
+}
+void BgzfReader::Fill(){
+    while(!IsStreamEOF && Window.size() < ReadAhead){
+        std::unique_ptr<BlockStruct> Block;
+        if(FreeBlocks.empty()) Block.reset(new BlockStruct());
+        else{
+            Block = std::move(FreeBlocks.back());
+            FreeBlocks.pop_back();
+        }
+        if(!ReadBlock(*Block)){
+            IsStreamEOF = true;
+            FreeBlocks.push_back(std::move(Block));
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            WorkQueue.push_back(Block.get());
+        }
+        WorkCV.notify_one();
+        Window.push_back(std::move(Block));
+    }
+}
+void BgzfReader::WorkerThread(){
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    bool IsInit = (inflateInit2(&zs, -15)==Z_OK);
+    while(true){
+        BlockStruct* Block;
+        {
+            std::unique_lock<std::mutex> Lock(Mutex);
+            WorkCV.wait(Lock, [&]{return !WorkQueue.empty() || IsClosed;});
+            if(WorkQueue.empty()) break;
+            Block = WorkQueue.front();
+            WorkQueue.pop_front();
+        }
+        StageClock Clock;
+        double Wall = 0, Cpu = 0;
+        Clock.Reset();
+        const std::string& In = Block->Compressed;
+        const unsigned char* Tail = reinterpret_cast<const unsigned char*>(In.data()) + In.size() - 8;
+        uint32_t CRC = Tail[0] | (Tail[1] << 8) | (Tail[2] << 16) | (uint32_t(Tail[3]) << 24);
+        uint32_t ISIZE = Tail[4] | (Tail[5] << 8) | (Tail[6] << 16) | (uint32_t(Tail[7]) << 24);
+        if(ISIZE > MaxBlockSize) Block->Error = "Invalid BGZF block size at offset " + std::to_string(Block->Offset);
+        else if(!IsInit) Block->Error = "Failed to initialize zlib";
+        else{
+            Block->Data.resize(ISIZE);
+            inflateReset(&zs);
+            zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(In.data()));
+            zs.avail_in = In.size()-8;
+            zs.next_out = reinterpret_cast<Bytef*>(&Block->Data[0]);
+            zs.avail_out = ISIZE;
+            int Ret = inflate(&zs, Z_FINISH);
+            if(Ret!=Z_STREAM_END || zs.total_out!=ISIZE)
+                Block->Error = "Failed to inflate BGZF block at offset " + std::to_string(Block->Offset);
+            else if(crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(Block->Data.data()), ISIZE)!=CRC)
+                Block->Error = "CRC mismatch in BGZF block at offset " + std::to_string(Block->Offset);
+        }
+        Clock.Lap(Wall, Cpu);
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            InflateWall += Wall;
+            InflateCpu += Cpu;
+            Block->IsDone = true;
+        }
+        DoneCV.notify_all();
+    }
+    if(IsInit) inflateEnd(&zs);
+}
+void BgzfReader::InflateTime(double& Wall, double& Cpu){
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Wall = InflateWall;
+    Cpu = InflateCpu;
+}
+bool BgzfReader::NextBlock(){
+    if(Current){
+        FreeBlocks.push_back(std::move(Window.front()));
+        Window.pop_front();
+        Current = nullptr;
+    }
+    Fill();
+    if(Window.empty()) return false;
+    BlockStruct* Front = Window.front().get();
+    {
+        std::unique_lock<std::mutex> Lock(Mutex);
+        DoneCV.wait(Lock, [&]{return Front->IsDone;});
+    }
+    if(!Front->Error.empty()) throw std::runtime_error(Front->Error);
+    Current = Front;
+    Pos = 0;
+    return true;
+}
+bool BgzfReader::GetLine(std::string& Line){
+    Line.clear();
+    bool HasData = false;
+    while(true){
+        if(!Current || Pos >= Current->Data.size()){
+            if(!NextBlock()) return HasData;
+            continue;
+        }
+        const char* Begin = Current->Data.data() + Pos;
+        size_t Left = Current->Data.size() - Pos;
+        const char* End = static_cast<const char*>(std::memchr(Begin, '\n', Left));
+        if(End){
+            Line.append(Begin, End-Begin);
+            Pos += End-Begin+1;
+            return true;
+        }
+        Line.append(Begin, Left);
+        Pos += Left;
+        HasData = true;
+    }
+}
+uint64_t BgzfReader::Tell(){
+    if(!Current) return (Window.empty() ? CompressedOffset : Window.front()->Offset) << 16;
+    if(Pos >= Current->Data.size()) return Current->NextOffset << 16;
+    return (Current->Offset << 16) | Pos;
+}
+void BgzfReader::Seek(uint64_t VirtualOffset){
+    uint64_t BlockOffset = VirtualOffset >> 16;
+    size_t BlockPos = VirtualOffset & 0xFFFF;
+    if(Current && Current->Offset==BlockOffset){
+        Pos = BlockPos;
+        return;
+    }
+    /*************
+        Drop the read-ahead window, blocks already being inflated are
+        waited for since workers still hold pointers to them
+    *************/
+    {
+        std::unique_lock<std::mutex> Lock(Mutex);
+        for(BlockStruct* Block : WorkQueue) Block->IsDone = true;
+        WorkQueue.clear();
+        DoneCV.wait(Lock, [&]{
+            for(const auto& Block : Window) if(!Block->IsDone) return false;
+            return true;
+        });
+    }
+    while(!Window.empty()){
+        FreeBlocks.push_back(std::move(Window.front()));
+        Window.pop_front();
+    }
+    Current = nullptr;
+    PrefixPos = Prefix.size();
+    Stream.clear();
+    Stream.seekg(BlockOffset, std::ios_base::beg);
+    if(!Stream) throw std::runtime_error("Can't seek BGZF input");
+    CompressedOffset = BlockOffset;
+    IsStreamEOF = false;
+    if(NextBlock()) Pos = BlockPos;
+}
+size_t BgzfReader::Read(char* Buffer, size_t Size){
+    size_t n = 0;
+    while(n < Size){
+        if(!Current || Pos >= Current->Data.size()){
+            if(!NextBlock()) break;
+            continue;
+        }
+        size_t Chunk = std::min(Size-n, Current->Data.size()-Pos);
+        std::memcpy(Buffer+n, Current->Data.data()+Pos, Chunk);
+        Pos += Chunk;
+        n += Chunk;
+    }
+    return n;
+}
+BgzfWriter::BgzfWriter(const std::string& Filename, size_t Threads, int Level) :
+    File(Filename, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc), Level(Level){
+    if(Threads < 1) Threads = 1;
+    MaxWindow = 4*Threads;
+    Buffer.reserve(BlockSize);
+    for(size_t i(0); i < Threads; i++) Workers.emplace_back(&BgzfWriter::WorkerThread, this);
+}
+BgzfWriter::BgzfWriter(const std::string& Filename, size_t Threads, const std::string& State, size_t& Pos){
+    /*************
+        Continues a file left by SaveState(), blocks written after
+        it are dropped and the unfinished block is filled again, so
+        the output is the same as without the interruption
+    *************/
+    auto Extract = [&](){
+        if(Pos + 8 > State.size()) throw std::runtime_error("Truncated BGZF writer state");
+        uint64_t Value = 0;
+        for(size_t i(0); i < 8; i++) Value |= uint64_t(static_cast<unsigned char>(State[Pos+i])) << (8*i);
+        Pos += 8;
+        return Value;
+    };
+    Level = static_cast<int>(Extract());
+    CompressedOffset = Extract();
+    BlockOffsets.resize(Extract());
+    for(uint64_t& Offset : BlockOffsets) Offset = Extract();
+    size_t Size = Extract();
+    if(Size >= BlockSize || Pos + Size > State.size()) throw std::runtime_error("Truncated BGZF writer state");
+    Buffer.reserve(BlockSize);
+    Buffer.assign(State, Pos, Size);
+    Pos += Size;
+    std::ifstream Input(Filename, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+    if(!Input.is_open() || static_cast<uint64_t>(Input.tellg()) < CompressedOffset)
+        throw std::runtime_error("Output file is shorter than its checkpoint");
+    Input.close();
+    if(truncate(Filename.c_str(), CompressedOffset)!=0) throw std::runtime_error("Can't truncate output file " + Filename);
+    File.open(Filename, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+    if(Threads < 1) Threads = 1;
+    MaxWindow = 4*Threads;
+    for(size_t i(0); i < Threads; i++) Workers.emplace_back(&BgzfWriter::WorkerThread, this);
+}
+BgzfWriter::~BgzfWriter(){
+    Stop();
+}
+bool BgzfWriter::IsOpen(){
+    return File.is_open();
+}
+void BgzfWriter::Stop(){
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        IsStopped = true;
+        WorkQueue.clear();
+    }
+    WorkCV.notify_all();
+    for(std::thread& T : Workers) if(T.joinable()) T.join();
+}
+uint64_t BgzfWriter::Tell(){
+    /*************
+        Block index and offset inside the block, the compressed offset
+        of a block is only known once it's written, see VirtualOffset()
+    *************/
+    return (uint64_t(BlockOffsets.size() + Window.size()) << 16) | Buffer.size();
+}
+uint64_t BgzfWriter::VirtualOffset(uint64_t Position){
+    size_t Block = Position >> 16;
+    if(Block >= BlockOffsets.size()) throw std::runtime_error("BGZF block not written yet");
+    return (BlockOffsets[Block] << 16) | (Position & 0xFFFF);
+}
+void BgzfWriter::Sync(){
+    /******* Every full block is written, the unfinished one stays in Buffer *******/
+    WriteFinished(true);
+    File.flush();
+    if(!File) throw std::runtime_error("Failed to write BGZF output");
+}
+void BgzfWriter::SaveState(std::string& Out){
+    Sync();
+    auto Append = [&](uint64_t Value){
+        for(size_t i(0); i < 8; i++) Out += char((Value >> (8*i)) & 0xFF);
+    };
+    Append(static_cast<uint64_t>(Level));
+    Append(CompressedOffset);
+    Append(BlockOffsets.size());
+    for(uint64_t Offset : BlockOffsets) Append(Offset);
+    Append(Buffer.size());
+    Out += Buffer;
+}
+void BgzfWriter::Write(const char* Data, size_t Size){
+    while(Size){
+        size_t Chunk = std::min(Size, BlockSize-Buffer.size());
+        Buffer.append(Data, Chunk);
+        Data += Chunk;
+        Size -= Chunk;
+        if(Buffer.size()==BlockSize) Submit();
+    }
+}
+void BgzfWriter::Submit(){
+    std::unique_ptr<BlockStruct> Block;
+    if(FreeBlocks.empty()) Block.reset(new BlockStruct());
+    else{
+        Block = std::move(FreeBlocks.back());
+        FreeBlocks.pop_back();
+    }
+    std::swap(Block->Data, Buffer);
+    Buffer.clear();
+    Block->IsDone = false;
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        WorkQueue.push_back(Block.get());
+    }
+    WorkCV.notify_one();
+    Window.push_back(std::move(Block));
+    WriteFinished(false);
+}
+void BgzfWriter::WriteFinished(bool IsDraining){
+    while(!Window.empty()){
+        BlockStruct& Front = *Window.front();
+        {
+            std::unique_lock<std::mutex> Lock(Mutex);
+            if(!Front.IsDone && !IsDraining && Window.size() < MaxWindow) break;
+            DoneCV.wait(Lock, [&]{return Front.IsDone;});
+        }
+        if(!Front.Error.empty()) throw std::runtime_error(Front.Error);
+        File.write(Front.Compressed.data(), Front.Compressed.size());
+        if(!File) throw std::runtime_error("Failed to write BGZF output");
+        BlockOffsets.push_back(CompressedOffset);
+        CompressedOffset += Front.Compressed.size();
+        FreeBlocks.push_back(std::move(Window.front()));
+        Window.pop_front();
+    }
+}
+void BgzfWriter::WorkerThread(){
+    z_stream zs, zsStored;
+    std::memset(&zs, 0, sizeof(zs));
+    std::memset(&zsStored, 0, sizeof(zsStored));
+    bool IsInit = deflateInit2(&zs, Level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY)==Z_OK &&
+                  deflateInit2(&zsStored, 0, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY)==Z_OK;
+    const size_t MaxBlock = 0x10000;
+    while(true){
+        BlockStruct* Block;
+        {
+            std::unique_lock<std::mutex> Lock(Mutex);
+            WorkCV.wait(Lock, [&]{return !WorkQueue.empty() || IsStopped;});
+            if(WorkQueue.empty()) break;
+            Block = WorkQueue.front();
+            WorkQueue.pop_front();
+        }
+        std::string& Out = Block->Compressed;
+        Out.resize(MaxBlock);
+        size_t Size = 0;
+        /*************
+            Incompressible data falls back to stored deflate blocks
+        *************/
+        for(z_stream* s : {&zs, &zsStored}){
+            if(!IsInit) break;
+            deflateReset(s);
+            s->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(Block->Data.data()));
+            s->avail_in = Block->Data.size();
+            s->next_out = reinterpret_cast<Bytef*>(&Out[BgzfReader::HeaderSize]);
+            s->avail_out = MaxBlock - BgzfReader::HeaderSize - 8;
+            if(deflate(s, Z_FINISH)==Z_STREAM_END){
+                Size = BgzfReader::HeaderSize + s->total_out + 8;
+                break;
+            }
+        }
+        if(Size==0) Block->Error = "Failed to compress BGZF block";
+        else{
+            static const unsigned char Header[BgzfReader::HeaderSize-2] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0};
+            std::memcpy(&Out[0], Header, sizeof(Header));
+            Out[16] = char((Size-1) & 0xFF);
+            Out[17] = char((Size-1) >> 8);
+            uint32_t CRC = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(Block->Data.data()), Block->Data.size());
+            uint32_t ISIZE = Block->Data.size();
+            for(int i(0); i < 4; i++){
+                Out[Size-8+i] = char((CRC >> (8*i)) & 0xFF);
+                Out[Size-4+i] = char((ISIZE >> (8*i)) & 0xFF);
+            }
+            Out.resize(Size);
+        }
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            Block->IsDone = true;
+        }
+        DoneCV.notify_all();
+    }
+    deflateEnd(&zs);
+    deflateEnd(&zsStored);
+}
+void BgzfWriter::Close(){
+    if(IsClosed) return;
+    IsClosed = true;
+    if(!Buffer.empty()) Submit();
+    WriteFinished(true);
+    /*************
+        Empty block as EOF marker, it also resolves offsets at the end of the data
+    *************/
+    Submit();
+    WriteFinished(true);
+    File.close();
+    if(!File) throw std::runtime_error("Failed to write BGZF output");
+    Stop();
+}
+PrefixedSource::PrefixedSource(std::istream& Stream, const std::string& Prefix) :
+    Stream(&Stream), Prefix(Prefix){
+}
+std::streamsize PrefixedSource::read(char* Buffer, std::streamsize Size){
+    std::streamsize n = 0;
+    if(PrefixPos < Prefix.size()){
+        n = std::min<std::streamsize>(Size, Prefix.size()-PrefixPos);
+        std::memcpy(Buffer, Prefix.data()+PrefixPos, n);
+        PrefixPos += n;
+    }
+    if(n < Size){
+        Stream->read(Buffer+n, Size-n);
+        n += Stream->gcount();
+    }
+    return n ? n : -1;
+}
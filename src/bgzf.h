@@ -0,0 +1,141 @@
+#ifndef BGZF_H
+#define BGZF_H
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <zlib.h>
+#include <boost/iostreams/categories.hpp>
+#include "metrics.h"
+/*************
+    BGZF is a series of independent gzip members (blocks) of at most
+    64KiB each, so blocks can be inflated in parallel and joined in order.
+*************/
+class BgzfReader
+{
+public:
+    BgzfReader(std::istream& Stream, size_t Threads, const std::string& Prefix = "");
+    ~BgzfReader();
+    static const size_t HeaderSize = 18;
+    static const size_t MaxBlockSize = 65536;
+    static bool IsBgzf(const char* Header, size_t Size);
+    bool GetLine(std::string& Line);
+    size_t Read(char* Buffer, size_t Size);
+    uint64_t Tell();
+    void Seek(uint64_t VirtualOffset);
+    void InflateTime(double& Wall, double& Cpu);
+private:
+    struct BlockStruct{
+        std::string Compressed, Data;
+        uint64_t Offset = 0, NextOffset = 0;
+        bool IsDone = false;
+        std::string Error;
+    };
+    /*************
+        FUNCTIONS
+    *************/
+    size_t ReadBytes(char* Buffer, size_t Size);
+    bool ReadBlock(BlockStruct& Block);
+    bool NextBlock();
+    void Fill();
+    void Stop();
+    void WorkerThread();
+    /*************
+        INPUT
+    *************/
+    std::istream& Stream;
+    std::string Prefix;
+    size_t PrefixPos = 0;
+    uint64_t CompressedOffset = 0;
+    bool IsStreamEOF = false;
+    /*************
+        WORKERS
+    *************/
+    std::vector<std::thread> Workers;
+    std::mutex Mutex;
+    std::condition_variable WorkCV, DoneCV;
+    std::deque<BlockStruct*> WorkQueue;
+    std::deque<std::unique_ptr<BlockStruct>> Window;
+    std::vector<std::unique_ptr<BlockStruct>> FreeBlocks;
+    size_t ReadAhead;
+    bool IsClosed = false;
+    double InflateWall = 0, InflateCpu = 0;
+    /*************
+        CURRENT BLOCK
+    *************/
+    BlockStruct* Current = nullptr;
+    size_t Pos = 0;
+};
+class BgzfWriter
+{
+public:
+    BgzfWriter(const std::string& Filename, size_t Threads, int Level = Z_DEFAULT_COMPRESSION);
+    BgzfWriter(const std::string& Filename, size_t Threads, const std::string& State, size_t& Pos);
+    ~BgzfWriter();
+    static const size_t BlockSize = 0xff00;
+    bool IsOpen();
+    void Write(const char* Data, size_t Size);
+    uint64_t Tell();
+    uint64_t VirtualOffset(uint64_t Position);
+    void Sync();
+    void SaveState(std::string& Out);
+    void Close();
+private:
+    struct BlockStruct{
+        std::string Data, Compressed;
+        bool IsDone = false;
+        std::string Error;
+    };
+    /*************
+        FUNCTIONS
+    *************/
+    void Submit();
+    void WriteFinished(bool IsDraining);
+    void Stop();
+    void WorkerThread();
+    /*************
+        OUTPUT
+    *************/
+    std::ofstream File;
+    std::string Buffer;
+    int Level;
+    bool IsClosed = false;
+    uint64_t CompressedOffset = 0;
+    std::vector<uint64_t> BlockOffsets;
+    /*************
+        WORKERS
+    *************/
+    std::vector<std::thread> Workers;
+    std::mutex Mutex;
+    std::condition_variable WorkCV, DoneCV;
+    std::deque<BlockStruct*> WorkQueue;
+    std::deque<std::unique_ptr<BlockStruct>> Window;
+    std::vector<std::unique_ptr<BlockStruct>> FreeBlocks;
+    size_t MaxWindow;
+    bool IsStopped = false;
+};
+/*************
+    Boost source that replays bytes already consumed by format
+    detection before reading the rest of the stream.
+*************/
+class PrefixedSource
+{
+public:
+    typedef char char_type;
+    typedef boost::iostreams::source_tag category;
+    PrefixedSource(std::istream& Stream, const std::string& Prefix);
+    std::streamsize read(char* Buffer, std::streamsize Size);
+private:
+    std::istream* Stream;
+    std::string Prefix;
+    size_t PrefixPos = 0;
+};
+#endif
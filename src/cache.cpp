@@ -0,0 +1,148 @@
+#include "cache.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+static const char CacheMagic[8] = {'L','C','V','C','F','C','1','\0'};
+static const size_t HeaderSize = 8 + 4 + 4 + 8 + 8 + 4;
+template<typename T> static void Append(std::string& Out, T Value){
+    Out.append(reinterpret_cast<const char*>(&Value), sizeof(T));
+}
+static void Pad(std::string& Out, size_t Alignment){
+    while(Out.size() % Alignment) Out += '\0';
+}
+uint16_t GenotypeCache::EncodeDepth(int Value){
+    if(Value < 0) return UINT16_MAX;
+    return Value >= UINT16_MAX ? UINT16_MAX-1 : Value;
+}
+uint8_t GenotypeCache::EncodeQuality(int Value){
+    if(Value < 0) return UINT8_MAX;
+    return Value >= UINT8_MAX ? UINT8_MAX-1 : Value;
+}
+int GenotypeCache::DecodeDepth(uint16_t Value){
+    return Value==UINT16_MAX ? -1 : Value;
+}
+int GenotypeCache::DecodeQuality(uint8_t Value){
+    return Value==UINT8_MAX ? -1 : Value;
+}
+CacheWriter::CacheWriter(const std::string& Filename, const std::vector<std::string>& Samples, uint32_t InputType, uint64_t InputSize) :
+    File(Filename, std::ios_base::out | std::ios_base::binary), nSamples(Samples.size()){
+    if(!File.is_open()) throw std::runtime_error("Can't write cache file " + Filename);
+    std::string Names;
+    for(const std::string& Name : Samples) Names += Name + '\0';
+    Buffer.append(CacheMagic, 8);
+    Append<uint32_t>(Buffer, nSamples);
+    Append<uint32_t>(Buffer, InputType);
+    Append<uint64_t>(Buffer, InputSize);
+    Append<uint64_t>(Buffer, UINT64_MAX);
+    Append<uint32_t>(Buffer, Names.size());
+    Buffer += Names;
+    Pad(Buffer, 8);
+}
+void CacheWriter::Write(uint64_t Offset, uint32_t Length, uint16_t Flags, const std::vector<uint16_t>& DP,
+                        const std::vector<uint8_t>& GQ, const std::vector<uint16_t>& AD, uint16_t Alleles){
+    Append<uint64_t>(Buffer, Offset);
+    Append<uint32_t>(Buffer, Length);
+    Append<uint16_t>(Buffer, Alleles);
+    Append<uint16_t>(Buffer, Flags);
+    Buffer.append(reinterpret_cast<const char*>(DP.data()), nSamples*sizeof(uint16_t));
+    Buffer.append(reinterpret_cast<const char*>(GQ.data()), nSamples);
+    Pad(Buffer, 2);
+    Buffer.append(reinterpret_cast<const char*>(AD.data()), size_t(Alleles)*nSamples*sizeof(uint16_t));
+    Pad(Buffer, 8);
+    nSites++;
+    if(Buffer.size() >= (1 << 22)){
+        File.write(Buffer.data(), Buffer.size());
+        Buffer.clear();
+    }
+}
+void CacheWriter::Close(){
+    File.write(Buffer.data(), Buffer.size());
+    Buffer.clear();
+    /*************
+        The site count is written last, an interrupted build keeps
+        UINT64_MAX and is rejected by CacheReader
+    *************/
+    File.seekp(8+4+4+8);
+    File.write(reinterpret_cast<const char*>(&nSites), sizeof(nSites));
+    File.close();
+    if(!File) throw std::runtime_error("Failed to write cache file");
+}
+uint64_t CacheWriter::Sites(){
+    return nSites;
+}
+CacheReader::CacheReader(const std::string& Filename){
+    try{
+        Open(Filename);
+    }
+    catch(...){
+        Close();
+        throw;
+    }
+}
+CacheReader::~CacheReader(){
+    Close();
+}
+void CacheReader::Open(const std::string& Filename){
+    fd = open(Filename.c_str(), O_RDONLY);
+    if(fd < 0) throw std::runtime_error("Can't open cache file " + Filename);
+    struct stat Info;
+    if(fstat(fd, &Info)!=0 || size_t(Info.st_size) < HeaderSize) throw std::runtime_error("Invalid cache file " + Filename);
+    void* Map = mmap(nullptr, Info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(Map==MAP_FAILED) throw std::runtime_error("Can't map cache file " + Filename);
+    Data = static_cast<const char*>(Map);
+    Length = Info.st_size;
+    madvise(Map, Length, MADV_SEQUENTIAL);
+    uint32_t nSamples, NamesSize;
+    if(std::memcmp(Data, CacheMagic, 8)!=0) throw std::runtime_error("Invalid cache file " + Filename);
+    std::memcpy(&nSamples, Data+8, 4);
+    std::memcpy(&Input, Data+12, 4);
+    std::memcpy(&Size, Data+16, 8);
+    std::memcpy(&nSites, Data+24, 8);
+    std::memcpy(&NamesSize, Data+32, 4);
+    if(nSites==UINT64_MAX) throw std::runtime_error("Incomplete cache file " + Filename);
+    if(HeaderSize + NamesSize > Length) throw std::runtime_error("Invalid cache file " + Filename);
+    for(const char *p = Data+HeaderSize, *End = p+NamesSize; p < End; p += SampleNames.back().size()+1)
+        SampleNames.emplace_back(p, strnlen(p, End-p));
+    if(SampleNames.size()!=nSamples) throw std::runtime_error("Invalid cache file " + Filename);
+    Pos = (HeaderSize + NamesSize + 7) / 8 * 8;
+}
+void CacheReader::Close(){
+    /******* Also called when Open throws part way through *******/
+    if(Data) munmap(const_cast<char*>(Data), Length);
+    if(fd >= 0) close(fd);
+    Data = nullptr;
+    fd = -1;
+}
+bool CacheReader::Next(GenotypeCache::SiteStruct& Entry){
+    if(Site >= nSites) return false;
+    const size_t nSamples = SampleNames.size();
+    if(Pos + 16 > Length) throw std::runtime_error("Truncated cache file");
+    std::memcpy(&Entry.Offset, Data+Pos, 8);
+    std::memcpy(&Entry.Length, Data+Pos+8, 4);
+    std::memcpy(&Entry.Alleles, Data+Pos+12, 2);
+    std::memcpy(&Entry.Flags, Data+Pos+14, 2);
+    size_t p = Pos + 16;
+    Entry.DP = reinterpret_cast<const uint16_t*>(Data+p);
+    p += nSamples*sizeof(uint16_t);
+    Entry.GQ = reinterpret_cast<const uint8_t*>(Data+p);
+    p = (p + nSamples + 1) / 2 * 2;
+    Entry.AD = reinterpret_cast<const uint16_t*>(Data+p);
+    p = (p + size_t(Entry.Alleles)*nSamples*sizeof(uint16_t) + 7) / 8 * 8;
+    if(p > Length) throw std::runtime_error("Truncated cache file");
+    Pos = p;
+    Site++;
+    return true;
+}
+const std::vector<std::string>& CacheReader::Samples(){
+    return SampleNames;
+}
+uint32_t CacheReader::InputType(){
+    return Input;
+}
+uint64_t CacheReader::InputSize(){
+    return Size;
+}
+uint64_t CacheReader::Sites(){
+    return nSites;
+}
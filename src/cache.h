@@ -0,0 +1,69 @@
+#ifndef CACHE_H
+#define CACHE_H
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+/*************
+    Binary sidecar with the genotype metrics Filter() needs. After a
+    header with the sample names, every site is stored as
+        Offset u64, Length u32, Alleles u16, Flags u16,
+        DP u16[Samples], GQ u8[Samples], AD u16[Alleles][Samples]
+    padded to 8 bytes. DP/AD saturate at 65534 and GQ at 254, the
+    largest value of each type means missing (-1).
+*************/
+class GenotypeCache
+{
+public:
+    struct SiteStruct{
+        uint64_t Offset = 0;
+        uint32_t Length = 0;
+        uint16_t Alleles = 0, Flags = 0;
+        const uint16_t* DP = nullptr;
+        const uint8_t* GQ = nullptr;
+        const uint16_t* AD = nullptr;
+    };
+    static const uint16_t FLAG_BAD_AD = 1;
+    static const uint32_t INPUT_TEXT = 0, INPUT_BGZF = 1;
+    static uint16_t EncodeDepth(int Value);
+    static uint8_t EncodeQuality(int Value);
+    static int DecodeDepth(uint16_t Value);
+    static int DecodeQuality(uint8_t Value);
+};
+class CacheWriter
+{
+public:
+    CacheWriter(const std::string& Filename, const std::vector<std::string>& Samples, uint32_t InputType, uint64_t InputSize);
+    void Write(uint64_t Offset, uint32_t Length, uint16_t Flags, const std::vector<uint16_t>& DP,
+               const std::vector<uint8_t>& GQ, const std::vector<uint16_t>& AD, uint16_t Alleles);
+    void Close();
+    uint64_t Sites();
+private:
+    std::ofstream File;
+    std::string Buffer;
+    size_t nSamples;
+    uint64_t nSites = 0;
+};
+class CacheReader
+{
+public:
+    CacheReader(const std::string& Filename);
+    ~CacheReader();
+    bool Next(GenotypeCache::SiteStruct& Site);
+    const std::vector<std::string>& Samples();
+    uint32_t InputType();
+    uint64_t InputSize();
+    uint64_t Sites();
+private:
+    void Open(const std::string& Filename);
+    void Close();
+    int fd = -1;
+    const char* Data = nullptr;
+    size_t Length = 0, Pos = 0;
+    std::vector<std::string> SampleNames;
+    uint32_t Input = 0;
+    uint64_t Size = 0, nSites = 0, Site = 0;
+};
+#endif
@@ -0,0 +1,215 @@
+#include "lcvcftools.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+/*************
+    A checkpoint holds the signature of the run, the output state,
+    the input position and line, the counters, the filter order and
+    the sample statistics, integers are little-endian
+*************/
+static const char CheckpointMagic[8] = {'L','C','V','C','F','K','1','\0'};
+template<typename T> static void Append(std::string& Out, T Value){
+    for(size_t i(0); i < sizeof(T); i++) Out += char((static_cast<uint64_t>(Value) >> (8*i)) & 0xFF);
+}
+template<typename T> static T Extract(const std::string& In, size_t& Pos){
+    if(Pos + sizeof(T) > In.size()) throw std::runtime_error("Truncated checkpoint file");
+    uint64_t Value = 0;
+    for(size_t i(0); i < sizeof(T); i++) Value |= uint64_t(static_cast<unsigned char>(In[Pos+i])) << (8*i);
+    Pos += sizeof(T);
+    return static_cast<T>(Value);
+}
+static void AppendCounts(std::string& Out, const std::vector<size_t>& Values){
+    Append<uint64_t>(Out, Values.size());
+    for(size_t Value : Values) Append<uint64_t>(Out, Value);
+}
+static void ExtractCounts(const std::string& In, size_t& Pos, std::vector<size_t>& Values){
+    if(Extract<uint64_t>(In, Pos)!=Values.size()) throw std::runtime_error("Checkpoint filters differ from the arguments");
+    for(size_t& Value : Values) Value = Extract<uint64_t>(In, Pos);
+}
+static void SyncFile(const std::string& Filename){
+    /******* Data the checkpoint points to must survive the node *******/
+    int fd = open(Filename.c_str(), O_RDONLY);
+    if(fd < 0) throw std::runtime_error("Can't open " + Filename);
+    int Result = fsync(fd);
+    close(fd);
+    if(Result!=0) throw std::runtime_error("Can't sync " + Filename);
+}
+std::string LCVCFtools::CheckpointSignature(){
+    /*************
+        Everything that changes which lines are written or how they
+        are counted, a checkpoint only resumes the same run
+    *************/
+    std::ostringstream sso;
+    sso << std::setprecision(17);
+    sso << InputFilename << '\n' << filesize << '\n' << OutputFilename << '\n'
+        << InputSamples << ';' << HeaderSamples.size() << ';' << IsID << IsRemoveMultiallelic << IsAdaptiveFilters << IsCsi << '\n'
+        << minDP << ';' << minGQ << ';' << minGCR << ';' << MAF << '\n';
+    for(size_t i(0); i < DPRlevel.size(); i++) sso << "DPR" << DPRlevel[i] << ',' << DPRvalue[i] << ';';
+    for(size_t i(0); i < GQRlevel.size(); i++) sso << "GQR" << GQRlevel[i] << ',' << GQRvalue[i] << ';';
+    sso << '\n' << IsSampleStats << IsStatsSketch << ';' << YLim << '\n';
+    for(const auto& Region : RegionMap)
+        for(const auto& Range : Region.second) sso << Region.first << ':' << Range.first << '-' << Range.second << ';';
+    return sso.str();
+}
+void LCVCFtools::OpenCheckpoint(){
+    if(CheckpointFilename.empty()) return;
+    if(!IsFile || !(Mapped || Bgzf)) Terminate("checkpoint needs a plain or BGZF compressed input file");
+    if(OnRecord || OutputFilename.empty()) Terminate("checkpoint needs an output file");
+    if(!IsResume) return;
+    std::ifstream File(CheckpointFilename, std::ios_base::in | std::ios_base::binary);
+    if(!File.is_open()){
+        Log("No checkpoint file, starting from the beginning...");
+        return;
+    }
+    CheckpointData.assign(std::istreambuf_iterator<char>(File), std::istreambuf_iterator<char>());
+    CheckpointPos = sizeof(CheckpointMagic);
+    if(CheckpointData.compare(0, sizeof(CheckpointMagic), std::string(CheckpointMagic, sizeof(CheckpointMagic)))!=0)
+        Terminate("Invalid checkpoint file");
+    std::string Signature;
+    try{
+        size_t Size = Extract<uint64_t>(CheckpointData, CheckpointPos);
+        if(CheckpointPos + Size > CheckpointData.size()) throw std::runtime_error("Truncated checkpoint file");
+        Signature = CheckpointData.substr(CheckpointPos, Size);
+        CheckpointPos += Size;
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+    if(Signature!=CheckpointSignature()) Terminate("Checkpoint was written with a different input, output or arguments");
+    IsResumed = true;
+}
+void LCVCFtools::ResumeOutput(){
+    /*************
+        Output written after the checkpoint is cut off, the header
+        and the records before it are kept
+    *************/
+    bool IsIndexed = false;
+    try{
+        if(Extract<uint8_t>(CheckpointData, CheckpointPos)==0){
+            uint64_t Size = Extract<uint64_t>(CheckpointData, CheckpointPos);
+            struct stat Info;
+            if(stat(OutputFilename.c_str(), &Info)!=0 || static_cast<uint64_t>(Info.st_size) < Size)
+                throw std::runtime_error("Output file is shorter than its checkpoint");
+            if(truncate(OutputFilename.c_str(), Size)!=0) throw std::runtime_error("Can't truncate output file " + OutputFilename);
+            PlainWriter.reset(new BufferedWriter(OutputFilename, true));
+            return;
+        }
+        Writer.reset(new BgzfWriter(OutputFilename, Threads, CheckpointData, CheckpointPos));
+        IsIndexed = Extract<uint8_t>(CheckpointData, CheckpointPos)!=0;
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+    if(!Writer->IsOpen()) Terminate("Output file is not writable");
+    if(!IsIndexed) return;
+    OpenIndex();
+    try{
+        Index->LoadState(CheckpointData, CheckpointPos);
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+}
+void LCVCFtools::ResumeCheckpoint(){
+    WorkerStruct& W = Workers[0];
+    try{
+        uint64_t Offset = Extract<uint64_t>(CheckpointData, CheckpointPos);
+        CheckpointLine = Extract<uint64_t>(CheckpointData, CheckpointPos);
+        Status.InputCounter = Extract<uint64_t>(CheckpointData, CheckpointPos);
+        Status.OutputCounter = Extract<uint64_t>(CheckpointData, CheckpointPos);
+        Status.RemovedGenotypeCallRate = Extract<uint64_t>(CheckpointData, CheckpointPos);
+        Status.RemovedMultiallelic = Extract<uint64_t>(CheckpointData, CheckpointPos);
+        Status.RemovedIndels = Extract<uint64_t>(CheckpointData, CheckpointPos);
+        Status.RemovedMAF = Extract<uint64_t>(CheckpointData, CheckpointPos);
+        ExtractCounts(CheckpointData, CheckpointPos, Status.RemovedDepthRate);
+        ExtractCounts(CheckpointData, CheckpointPos, Status.RemovedQualityRate);
+        ExtractCounts(CheckpointData, CheckpointPos, W.FilterOrder);
+        ExtractCounts(CheckpointData, CheckpointPos, W.FilterRejections);
+        W.FilterSites = Extract<uint64_t>(CheckpointData, CheckpointPos);
+        if(IsSampleStats) SampleStats.LoadState(CheckpointData, CheckpointPos);
+        if(CheckpointPos!=CheckpointData.size()) throw std::runtime_error("Invalid checkpoint file");
+        if(Mapped){
+            if(Offset > Mapped->Size()) throw std::runtime_error("Checkpoint is past the end of the input");
+            Mapped->Seek(Offset);
+        }
+        else Bgzf->Seek(Offset);
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+    /******* Every worker starts from the saved filter order *******/
+    for(WorkerStruct& tmpWorker : Workers){
+        tmpWorker.FilterOrder = W.FilterOrder;
+        tmpWorker.FilterRejections = W.FilterRejections;
+        tmpWorker.FilterSites = W.FilterSites;
+    }
+    std::string().swap(CheckpointData);
+    Log("Resuming after line " + std::to_string(CheckpointLine) + " of the input...");
+}
+bool LCVCFtools::IsCheckpointDue(){
+    return !CheckpointFilename.empty() && std::chrono::steady_clock::now() >= NextCheckpoint;
+}
+void LCVCFtools::SaveCheckpoint(size_t LineNumber){
+    /*************
+        Called when every line up to LineNumber is written and
+        counted. The output is synced before the checkpoint is
+        renamed over the previous one, so a checkpoint never points
+        past the data that reached the disk.
+    *************/
+    std::string Out(CheckpointMagic, sizeof(CheckpointMagic));
+    std::string Signature = CheckpointSignature();
+    Append<uint64_t>(Out, Signature.size());
+    Out += Signature;
+    try{
+        if(Writer){
+            Append<uint8_t>(Out, 1);
+            Writer->SaveState(Out);
+            Append<uint8_t>(Out, Index ? 1 : 0);
+            if(Index) Index->SaveState(Out);
+        }
+        else{
+            PlainWriter->Flush();
+            struct stat Info;
+            if(stat(OutputFilename.c_str(), &Info)!=0) throw std::runtime_error("Can't read the size of " + OutputFilename);
+            Append<uint8_t>(Out, 0);
+            Append<uint64_t>(Out, Info.st_size);
+        }
+        SyncFile(OutputFilename);
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+    WorkerStruct& W = Workers[0];
+    Append<uint64_t>(Out, Mapped ? Mapped->Tell() : Bgzf->Tell());
+    Append<uint64_t>(Out, LineNumber);
+    Append<uint64_t>(Out, Status.InputCounter);
+    Append<uint64_t>(Out, Status.OutputCounter);
+    Append<uint64_t>(Out, Status.RemovedGenotypeCallRate);
+    Append<uint64_t>(Out, Status.RemovedMultiallelic);
+    Append<uint64_t>(Out, Status.RemovedIndels);
+    Append<uint64_t>(Out, Status.RemovedMAF);
+    AppendCounts(Out, Status.RemovedDepthRate);
+    AppendCounts(Out, Status.RemovedQualityRate);
+    AppendCounts(Out, W.FilterOrder);
+    AppendCounts(Out, W.FilterRejections);
+    Append<uint64_t>(Out, W.FilterSites);
+    if(IsSampleStats){
+        SampleStatistics Stats(SampleStats);
+        for(WorkerStruct& tmpWorker : Workers) if(tmpWorker.SampleStats.Samples()) Stats.Merge(tmpWorker.SampleStats);
+        Stats.SaveState(Out);
+    }
+    std::string tmpFilename = CheckpointFilename + ".tmp";
+    std::ofstream File(tmpFilename, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    File.write(Out.data(), Out.size());
+    File.close();
+    try{
+        if(!File) throw std::runtime_error("Failed to write");
+        SyncFile(tmpFilename);
+        if(std::rename(tmpFilename.c_str(), CheckpointFilename.c_str())!=0) throw std::runtime_error("Failed to rename");
+    }
+    catch(const std::runtime_error&){
+        Log("Can't write checkpoint file " + CheckpointFilename);
+    }
+    NextCheckpoint = std::chrono::steady_clock::now() +
+                     std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(CheckpointInterval));
+}
@@ -0,0 +1,295 @@
+#include "lcvcftools.h"
+LCVCFtools::LCVCFtools(int argc, char* argv[]){
+    /*************
+        Read Args
+    *************/
+    std::vector<std::string> args;
+    for(int i(1); i < argc; i++) args.push_back(std::string(argv[i]));
+    FilterConfig Config;
+    SetParameters(args, Config);
+    ApplyConfig(Config);
+}
+void LCVCFtools::ShowHelp(){
+    std::clog << "LCVCFtools Version " << THIS_VERSION << " is under GNU GPLv3.0\n" <<
+                 "Documentation and source code available at https://github.com/marcusnizalvarez/LCVCFtools\n"
+                 "If you would like more information, please contact me at marcus.alvarez@unesp.br\n"
+                 "\n"
+                 "[Input mode] \n"
+                 "--vcf    <STRING>       Read from VCF file. Use - to read from stdin.\n"
+                 "--gzvcf  <STRING>       Read from Gzip/BGZF compressed VCF file. Use - to read from stdin.\n"
+                 "--bcf    <STRING>       Read from BCF file. Use - to read from stdin.\n"
+                 "--vcf-list <STRING>     Read the VCF/BCF files listed in a file (one per line, format from the extension)\n"
+                 "                        concurrently with --threads, counters and sample statistics are merged.\n"
+                 "\n"
+                 "[Output mode] \n"
+                 "--out    <STRING>       Write to file instead of stdout. Names ending in .gz are written as BGZF with a .tbi index.\n"
+                 "--csi                   Write a .csi index instead of .tbi, for contigs longer than 2^29.\n"
+                 "--out-suffix <STRING>   With --vcf-list, write one output per input named after the input\n"
+                 "                        without its extension plus this suffix, instead of concatenating them.\n"
+                 "\n"
+                 "[Filter parameters] \n"
+                 "--minGQ  <INT>          Minimum genotype quality in PhredScale. [Default=20]\n"
+                 "--minDP  <INT>          Minimum depth. [Default=5]\n"
+                 "--MAF    <FLOAT>        Minor allele frequency, based on allele depth (AD). [Default=0.1]\n"
+                 "--minGCR <FLOAT>        Minimum Genotype Call rate. [Default=0]\n"
+                 "--minDPR <INT> <FLOAT>  Minimum Depth rate.\n"
+                 "--minGQR <INT> <FLOAT>  Minimum Genotype Quality rate.\n"
+                 "--sweep  <STRING>       Evaluate every parameter combination of a TSV grid in one pass and write\n"
+                 "                        pass/removed counts per combination instead of the VCF.\n"
+                 "--adaptive-filters      Check GCR/DPR/GQR in order of their rejection rates, removed variants may be\n"
+                 "                        counted under a different filter than the default GCR, DPR, GQR order.\n"
+                 "\n"
+                 "[Other arguments] \n"
+                 "--remove <STRING>       Remove samples listed in a file.\n"
+                 "--keep   <STRING>       Keep samples listed in a file, after --remove.\n"
+                 "--region <STRING>       Only read variants overlapping chr, chr:pos, chr:start-end or chr:start-, can be repeated.\n"
+                 "--regions-file <STRING> Only read variants overlapping regions listed in a file (chr, start, end; 1-based inclusive).\n"
+                 "                        A .tbi/.csi index next to a BGZF input is used to seek, otherwise the input is scanned.\n"
+                 "--build-cache <STRING>  Write DP, GQ and AD of every variant to a binary cache file instead of filtering.\n"
+                 "--from-cache <STRING>   Filter with a cache built from the same input and samples, only records\n"
+                 "                        that pass are read again from the input.\n"
+                 "--sample-stats          Output sample statistics to 'stats1.tsv'.\n"
+                 "--stats-limit <INT>     Highest DP/GQ level kept in sample statistics, larger values are counted there. [Default=100]\n"
+                 "--stats-sketch          Keep uncapped DP/GQ sketches in sample statistics and output their p5/p50/p95.\n"
+                 "--keep-multiallelic     Don't skip multiallelic (MAL) variants.\n"
+                 "--ID                    Generate generic ID, useful for programs like Plink.\n"
+                 "--threads <INT>         Number of threads used to decompress BGZF input and to parse and filter variants. [Default=1]\n"
+                 "--split-samples         Split the samples of each record across --threads instead of giving each thread\n"
+                 "                        whole records, for cohorts with very long lines.\n"
+                 "--metrics <STRING>      Write run metrics (stage times, throughput, peak RSS, allocations, counters) as JSON.\n"
+                 "--metrics-interval <FLOAT> Seconds between metrics updates while running. [Default=10]\n"
+                 "--checkpoint <STRING>   Periodically save the input and output positions, counters and sample statistics to a file.\n"
+                 "--checkpoint-interval <FLOAT> Seconds between checkpoints. [Default=60]\n"
+                 "--resume                Continue from the --checkpoint file with the same arguments, starts over when there is none.\n"
+                 "--verbose               Verbose mode.\n"
+                 "--help                  Print this message.\n"
+              << std::endl;
+}
+void LCVCFtools::SetParameters(std::vector<std::string>& args, FilterConfig& Config){
+    /*************
+        Only parses the arguments, values are checked by ApplyConfig()
+    *************/
+    if(args.empty()) {
+        ShowHelp();
+        throw 0;
+    }
+    for(size_t i(0); i < args.size(); i++){
+        if(args[i]=="--vcf"){
+            CheckARG("input");
+            if(++i >= args.size()) Terminate("Missing argument value for input file");
+            Config.InputFilename = args[i];
+            Config.Format = FilterConfig::FORMAT_VCF;
+            continue;
+        }
+        if(args[i]=="--gzvcf"){
+            CheckARG("input");
+            if(++i >= args.size()) Terminate("Missing argument value for input file");
+            Config.InputFilename = args[i];
+            Config.Format = FilterConfig::FORMAT_GZVCF;
+            continue;
+        }
+        if(args[i]=="--bcf"){
+            CheckARG("input");
+            if(++i >= args.size()) Terminate("Missing argument value for input file");
+            Config.InputFilename = args[i];
+            Config.Format = FilterConfig::FORMAT_BCF;
+            continue;
+        }
+        if(args[i]=="--vcf-list"){
+            CheckARG("input");
+            if(++i >= args.size()) Terminate("Missing argument value for vcf-list");
+            Config.ListFilename = args[i];
+            continue;
+        }
+        if(args[i]=="--out"){
+            CheckARG("out");
+            if(++i >= args.size()) Terminate("Missing argument value for out");
+            Config.OutputFilename = args[i];
+            continue;
+        }
+        if(args[i]=="--out-suffix"){
+            CheckARG("out-suffix");
+            if(++i >= args.size()) Terminate("Missing argument value for out-suffix");
+            Config.OutputSuffix = args[i];
+            continue;
+        }
+        if(args[i]=="--csi"){
+            CheckARG("csi");
+            Config.IsCsi = true;
+            continue;
+        }
+        if(args[i]=="--minGQ"){
+            CheckARG("minGQ");
+            if(++i >= args.size()) Terminate("Missing argument value for minGQ");
+            Config.minGQ = std::stoi(args[i]);
+            continue;
+        }
+        if(args[i]=="--minDP"){
+            CheckARG("minDP");
+            if(++i >= args.size()) Terminate("Missing argument value for minDP");
+            Config.minDP = std::stoi(args[i]);
+            continue;
+        }
+        if(args[i]=="--minGCR"){
+            CheckARG("minGCR");
+            if(++i >= args.size()) Terminate("Missing argument value for minGCR");
+            Config.minGCR = std::stod(args[i]);
+            continue;
+        }
+        if(args[i]=="--MAF"){
+            CheckARG("MAF");
+            if(++i >= args.size()) Terminate("Missing argument value for MAF");
+            Config.MAF = std::stod(args[i]);
+            continue;
+        }
+        if(args[i]=="--minDPR"){
+            CheckARG("minDPR", false);
+            if(i+2 >= args.size()) Terminate("Missing arguments value for minDPR");
+            Config.DPRlevel.push_back(std::stoi(args[++i]));
+            Config.DPRvalue.push_back(std::stod(args[++i]));
+            continue;
+        }
+        if(args[i]=="--minGQR"){
+            CheckARG("minGQR", false);
+            if(i+2 >= args.size()) Terminate("Missing arguments value for minGQR");
+            Config.GQRlevel.push_back(std::stoi(args[++i]));
+            Config.GQRvalue.push_back(std::stod(args[++i]));
+            continue;
+        }
+        if(args[i]=="--sweep"){
+            CheckARG("sweep");
+            if(++i >= args.size()) Terminate("Missing argument value for sweep");
+            Config.SweepFilename = args[i];
+            continue;
+        }
+        if(args[i]=="--adaptive-filters"){
+            CheckARG("adaptive-filters");
+            Config.IsAdaptiveFilters = true;
+            continue;
+        }
+        if(args[i]=="--threads"){
+            CheckARG("threads");
+            if(++i >= args.size()) Terminate("Missing argument value for threads");
+            if(std::stoi(args[i]) < 1) Terminate("threads must be greater than 0");
+            Config.Threads = std::stoi(args[i]);
+            continue;
+        }
+        if(args[i]=="--split-samples"){
+            CheckARG("split-samples");
+            Config.IsSplitSamples = true;
+            continue;
+        }
+        if(args[i]=="--sample-stats"){
+            CheckARG("sample-stats");
+            Config.IsSampleStats = true;
+            continue;
+        }
+        if(args[i]=="--stats-limit"){
+            CheckARG("stats-limit");
+            if(++i >= args.size()) Terminate("Missing argument value for stats-limit");
+            Config.StatsLimit = std::stoi(args[i]);
+            continue;
+        }
+        if(args[i]=="--stats-sketch"){
+            CheckARG("stats-sketch");
+            Config.IsStatsSketch = true;
+            continue;
+        }
+        if(args[i]=="--keep-multiallelic"){
+            CheckARG("keep-multiallelic");
+            Config.IsRemoveMultiallelic = false;
+            continue;
+        }
+        if(args[i]=="--ID"){
+            CheckARG("ID");
+            Config.IsID = true;
+            continue;
+        }
+        if(args[i]=="--remove"){
+            CheckARG("remove");
+            if(++i >= args.size()) Terminate("Missing argument value for remove");
+            Config.RemoveFilename = args[i];
+            continue;
+        }
+        if(args[i]=="--keep"){
+            CheckARG("keep");
+            if(++i >= args.size()) Terminate("Missing argument value for remove");
+            Config.KeepFilename = args[i];
+            continue;
+        }
+        if(args[i]=="--region"){
+            CheckARG("region", false);
+            if(++i >= args.size()) Terminate("Missing argument value for region");
+            Config.Regions.push_back(args[i]);
+            continue;
+        }
+        if(args[i]=="--regions-file"){
+            CheckARG("regions-file");
+            if(++i >= args.size()) Terminate("Missing argument value for regions-file");
+            Config.RegionsFilename = args[i];
+            continue;
+        }
+        if(args[i]=="--build-cache"){
+            CheckARG("build-cache");
+            if(++i >= args.size()) Terminate("Missing argument value for build-cache");
+            Config.CacheFilename = args[i];
+            Config.IsBuildCache = true;
+            continue;
+        }
+        if(args[i]=="--from-cache"){
+            CheckARG("from-cache");
+            if(++i >= args.size()) Terminate("Missing argument value for from-cache");
+            Config.CacheFilename = args[i];
+            continue;
+        }
+        if(args[i]=="--metrics"){
+            CheckARG("metrics");
+            if(++i >= args.size()) Terminate("Missing argument value for metrics");
+            Config.MetricsFilename = args[i];
+            continue;
+        }
+        if(args[i]=="--metrics-interval"){
+            CheckARG("metrics-interval");
+            if(++i >= args.size()) Terminate("Missing argument value for metrics-interval");
+            Config.MetricsInterval = std::stod(args[i]);
+            continue;
+        }
+        if(args[i]=="--checkpoint"){
+            CheckARG("checkpoint");
+            if(++i >= args.size()) Terminate("Missing argument value for checkpoint");
+            Config.CheckpointFilename = args[i];
+            continue;
+        }
+        if(args[i]=="--checkpoint-interval"){
+            CheckARG("checkpoint-interval");
+            if(++i >= args.size()) Terminate("Missing argument value for checkpoint-interval");
+            Config.CheckpointInterval = std::stod(args[i]);
+            continue;
+        }
+        if(args[i]=="--resume"){
+            CheckARG("resume");
+            Config.IsResume = true;
+            continue;
+        }
+        if(args[i]=="--verbose"){
+            CheckARG("verbose");
+            Config.IsVerbose = IsVerbose = true;
+            continue;
+        }
+        if(args[i]=="--help"){
+            ShowHelp();
+            throw 0;
+        }
+        Terminate(args[i] + " is an invalid argument");
+    }
+    if(DefinedArguments.find("input")==DefinedArguments.end())
+        Terminate("Missing input mode argument");
+    if(Config.IsStatsSketch && DefinedArguments.count("stats-limit")) Terminate("stats-limit can't be used with stats-sketch");
+    if(Config.IsBuildCache && DefinedArguments.count("from-cache")) Terminate("build-cache and from-cache can't be used together");
+}
+void LCVCFtools::CheckARG(std::string Argument, bool IsUnique){
+    if(IsUnique)
+        if(DefinedArguments.find(Argument)!=DefinedArguments.end())
+            Terminate("Multiple " + Argument + " definition");
+    DefinedArguments.insert(Argument);
+}
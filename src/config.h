@@ -0,0 +1,75 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <boost/utility/string_view.hpp>
+/*************
+    Library interface: the command line fills a FilterConfig, programs
+    linking the library fill one themselves and receive the passing
+    records through a callback instead of an output file.
+*************/
+class LCVCFerror : public std::runtime_error
+{
+public:
+    explicit LCVCFerror(const std::string& Msg) : std::runtime_error(Msg){}
+};
+struct FilterConfig{
+    enum FormatEnum {FORMAT_VCF, FORMAT_GZVCF, FORMAT_BCF};
+    /*************
+        INPUT / OUTPUT
+    *************/
+    std::string InputFilename = "-";
+    FormatEnum Format = FORMAT_VCF;
+    std::string ListFilename;
+    std::string OutputFilename;
+    std::string OutputSuffix;
+    bool IsCsi = false;
+    /*************
+        FILTER PARAMETERS
+    *************/
+    int    minDP = 5;
+    int    minGQ = 20;
+    double minGCR = 0;
+    double MAF = 0.1;
+    std::vector<int>    DPRlevel, GQRlevel;
+    std::vector<double> DPRvalue, GQRvalue;
+    bool IsRemoveMultiallelic = true;
+    bool IsAdaptiveFilters = false;
+    bool IsID = false;
+    /*************
+        SAMPLES AND REGIONS
+    *************/
+    std::string KeepFilename, RemoveFilename;
+    std::vector<std::string> Regions;
+    std::string RegionsFilename;
+    /*************
+        OTHER PARAMETERS
+    *************/
+    std::string SweepFilename;
+    std::string CacheFilename;
+    bool IsBuildCache = false;
+    bool IsSampleStats = false;
+    std::string SampleStatsFilename = "stats1.tsv";
+    int StatsLimit = 100;
+    bool IsStatsSketch = false;
+    std::string MetricsFilename;
+    double MetricsInterval = 10;
+    std::string CheckpointFilename;
+    double CheckpointInterval = 60;
+    bool IsResume = false;
+    size_t Threads = 1;
+    bool IsSplitSamples = false;
+    bool IsVerbose = false;
+};
+/*************
+    A passing record as written to the output, the views point into
+    a buffer that is only valid during the callback
+*************/
+struct RecordView{
+    boost::string_view Line, CHR, POS, ID, REF, ALT, QUAL, FILTER, INFO, FORMAT, Samples;
+};
+typedef std::function<void(const RecordView&)> RecordCallback;
+typedef std::function<void(const std::string&)> HeaderCallback;
+#endif
@@ -0,0 +1,335 @@
+#include "lcvcftools.h"
+void LCVCFtools::ReadSweepFile(std::string Filename){
+    /*************
+        First line names the columns (minDP, minGQ, minGCR, MAF, minDPR,
+        minGQR), missing columns take the command line values. minDPR
+        and minGQR cells hold LEVEL,RATE pairs separated by ';' or '.'
+    *************/
+    std::ifstream File(Filename);
+    if(!File.is_open()) Terminate("Sweep grid file does not exist or is not readable.");
+    std::vector<std::string> Columns;
+    std::string tmpString;
+    while(std::getline(File, tmpString)){
+        if(!tmpString.empty() && tmpString.back()=='\r') tmpString.pop_back();
+        if(tmpString.empty() || tmpString[0]=='#') continue;
+        std::vector<std::string> tmpFields;
+        boost::split(tmpFields, tmpString, boost::algorithm::is_any_of("\t"));
+        if(Columns.empty()){
+            for(const std::string& Column : tmpFields)
+                if(Column!="minDP" && Column!="minGQ" && Column!="minGCR" && Column!="MAF" && Column!="minDPR" && Column!="minGQR")
+                    Terminate("Unknown sweep grid column '" + Column + "'");
+            Columns = tmpFields;
+            continue;
+        }
+        if(tmpFields.size()!=Columns.size()) Terminate("Incorrect number of columns in sweep grid line: " + tmpString);
+        SweepStruct P;
+        P.minDP = minDP;
+        P.minGQ = minGQ;
+        P.minGCR = minGCR;
+        P.MAF = MAF;
+        P.DPRlevel = DPRlevel;
+        P.DPRvalue = DPRvalue;
+        P.GQRlevel = GQRlevel;
+        P.GQRvalue = GQRvalue;
+        try{
+            for(size_t i(0); i < Columns.size(); i++){
+                const std::string& Value = tmpFields[i];
+                if(Columns[i]=="minDP") P.minDP = std::stoi(Value);
+                else if(Columns[i]=="minGQ") P.minGQ = std::stoi(Value);
+                else if(Columns[i]=="minGCR") P.minGCR = std::stod(Value);
+                else if(Columns[i]=="MAF") P.MAF = std::stod(Value);
+                else{
+                    std::vector<int>& Levels = (Columns[i]=="minDPR") ? P.DPRlevel : P.GQRlevel;
+                    std::vector<double>& Rates = (Columns[i]=="minDPR") ? P.DPRvalue : P.GQRvalue;
+                    Levels.clear();
+                    Rates.clear();
+                    if(Value=="." || Value.empty()) continue;
+                    std::vector<std::string> tmpPairs;
+                    boost::split(tmpPairs, Value, boost::algorithm::is_any_of(";"));
+                    for(const std::string& Pair : tmpPairs){
+                        size_t Comma = Pair.find(',');
+                        if(Comma==std::string::npos) throw std::invalid_argument(Pair);
+                        Levels.push_back(std::stoi(Pair.substr(0, Comma)));
+                        Rates.push_back(std::stod(Pair.substr(Comma+1)));
+                        if(Levels.back() < 0 || Rates.back() < 0 || Rates.back() > 1) throw std::invalid_argument(Pair);
+                    }
+                }
+            }
+        }
+        catch(const std::logic_error&){
+            Terminate("Invalid value in sweep grid line: " + tmpString);
+        }
+        if(P.minDP <= 0 || P.minGQ <= 0 || P.minGCR < 0 || P.minGCR > 1 || P.MAF < 0 || P.MAF > 1)
+            Terminate("Parameter out of range in sweep grid line: " + tmpString);
+        SweepGrid.push_back(std::move(P));
+    }
+    if(SweepGrid.empty()) Terminate("No parameter combinations in sweep grid file.");
+    Log(std::to_string(SweepGrid.size()) + " parameter combinations in sweep grid...");
+}
+bool LCVCFtools::CheckRate(const std::vector<int> &vec, int val, double qnt){
+    size_t Count(0);
+    GenotypeKernels::CountAtLeast(vec.data(), vec.size(), &val, 1, &Count);
+    return(static_cast<double>(Count)/vec.size()<qnt);
+}
+double LCVCFtools::MinorAlleleFrequency(WorkerStruct& W){
+    /*************
+        AD of samples with DP>0 (W.DPvalues) goes into one column per
+        allele with the per sample sums next to it, samples with
+        DP==0 have a zero sum. Returns -1 when no sample has allele
+        depths.
+    *************/
+    const size_t nSamples = W.SnpData.SampleDataVector.size(), nAlleles = W.SnpData.AlleleCountVector.size();
+    W.ADcolumns.resize(nAlleles*nSamples);
+    W.ADsums.resize(nSamples);
+    if(SampleChunks.empty()) ReadAlleles(W, W, 0, nSamples);
+    else RunChunks(CHUNK_ALLELES);
+    for(size_t i(0); i < nAlleles; i++)
+        W.SnpData.AlleleCountVector[i] = GenotypeKernels::SumFractions(&W.ADcolumns[i*nSamples], W.ADsums.data(), nSamples);
+    return MinorAlleleShare(W);
+}
+void LCVCFtools::ReadAlleles(WorkerStruct& W, WorkerStruct& Record, size_t Begin, size_t End){
+    const std::vector<SampleDataStruct>& Samples = Record.SnpData.SampleDataVector;
+    const size_t nSamples = Samples.size(), nAlleles = Record.SnpData.AlleleCountVector.size();
+    std::vector<int>& AD = W.ADvalues;
+    for(size_t k(Begin); k < End; k++){
+        Record.ADsums[k] = 0;
+        if(Record.DPvalues[k]==0) continue;
+        AD.clear();
+        if(W.SnpData.IsBcf) SampleInts(W, Samples[k], W.Layout->ADslot, AD);
+        else ParseInts(Samples[k].AD.begin(), Samples[k].AD.end(), AD);
+        if(AD.size()!=nAlleles)
+            Terminate("Fatal error at AD.size()!=AlleleCount.size()");
+        int tmpADsum(0);
+        for(size_t i(0); i < nAlleles; i++){
+            tmpADsum += AD[i];
+            Record.ADcolumns[i*nSamples+k] = AD[i];
+        }
+        Record.ADsums[k] = tmpADsum;
+    }
+}
+double LCVCFtools::MinorAlleleShare(WorkerStruct& W){
+    /******* The major allele is the largest share, no ordering is needed *******/
+    const std::vector<double>& Alleles = W.SnpData.AlleleCountVector;
+    double AlleleSum(0), Major(0);
+    for(double Share : Alleles){
+        AlleleSum += Share;
+        Major = std::max(Major, Share);
+    }
+    if(AlleleSum==0) return -1;
+    return 1-Major/AlleleSum;
+}
+void LCVCFtools::SweepSite(WorkerStruct& W){
+    /*************
+        DP and GQ are decoded once, every grid combination is then
+        checked in the same order as Filter()
+    *************/
+    if(IsRemoveMultiallelic && W.SnpData.AlleleCountVector.size()>2){
+        for(StatusStruct& S : W.SweepStatus) S.RemovedMultiallelic++;
+        return;
+    }
+    const std::vector<SampleDataStruct>& Samples = W.SnpData.SampleDataVector;
+    const size_t nSamples = Samples.size();
+    std::vector<int> &tmpDP = W.DPvalues, &tmpGQ = W.GQvalues;
+    tmpDP.resize(nSamples);
+    tmpGQ.resize(nSamples);
+    for(size_t k(0); k < nSamples; k++){
+        DecodeSample(W, Samples[k], tmpDP[k], tmpGQ[k]);
+        if(tmpDP[k]==0) tmpGQ[k] = 0;
+    }
+    bool IsCounted = false;
+    double MinorFrequency = 0;
+    for(size_t c(0); c < SweepGrid.size(); c++){
+        const SweepStruct& P = SweepGrid[c];
+        StatusStruct& S = W.SweepStatus[c];
+        size_t Called = 0;
+        for(size_t k(0); k < nSamples; k++)
+            if(tmpDP[k]!=0 && tmpDP[k]>=P.minDP && tmpGQ[k]>=P.minGQ) Called++;
+        if(static_cast<double>(Called)/nSamples < P.minGCR){
+            S.RemovedGenotypeCallRate++;
+            continue;
+        }
+        const size_t nDPR = P.DPRlevel.size(), nGQR = P.GQRlevel.size();
+        W.FilterCounts.assign(nDPR+nGQR, 0);
+        GenotypeKernels::CountAtLeast(tmpDP.data(), nSamples, P.DPRlevel.data(), nDPR, W.FilterCounts.data());
+        GenotypeKernels::CountAtLeast(tmpGQ.data(), nSamples, P.GQRlevel.data(), nGQR, W.FilterCounts.data()+nDPR);
+        bool IsRemoved = false;
+        for(size_t i(0); i < nDPR && !IsRemoved; i++){
+            if(static_cast<double>(W.FilterCounts[i])/nSamples < P.DPRvalue[i]){
+                S.RemovedDepthRate[i]++;
+                IsRemoved = true;
+            }
+        }
+        for(size_t i(0); i < nGQR && !IsRemoved; i++){
+            if(static_cast<double>(W.FilterCounts[nDPR+i])/nSamples < P.GQRvalue[i]){
+                S.RemovedQualityRate[i]++;
+                IsRemoved = true;
+            }
+        }
+        if(IsRemoved) continue;
+        if(P.MAF>0){
+            if(!IsCounted){
+                MinorFrequency = MinorAlleleFrequency(W);
+                IsCounted = true;
+            }
+            if(MinorFrequency<P.MAF){
+                S.RemovedMAF++;
+                continue;
+            }
+        }
+        S.OutputCounter++;
+    }
+}
+bool LCVCFtools::CacheFilter(WorkerStruct& W, const GenotypeCache::SiteStruct& Site){
+    /*************
+        Same checks and counters as Filter() on the cached arrays,
+        returns true for sites Filter() must still see. Sites whose
+        AD wasn't cached stop before MAF.
+    *************/
+    if(IsRemoveMultiallelic && Site.Alleles>2){
+        W.Status.RemovedMultiallelic++;
+        return false;
+    }
+    UpdateFilterOrder(W);
+    const size_t nSamples = HeaderSamples.size();
+    const size_t nDPR = DPRlevel.size(), nGQR = GQRlevel.size();
+    std::vector<int> &tmpDP = W.DPvalues, &tmpGQ = W.GQvalues;
+    tmpDP.resize(nSamples);
+    tmpGQ.resize(nSamples);
+    W.FilterCounts.assign(1+nDPR+nGQR, 0);
+    for(size_t k(0); k < nSamples; k++){
+        int DP = GenotypeCache::DecodeDepth(Site.DP[k]);
+        int GQ = DP==0 ? 0 : GenotypeCache::DecodeQuality(Site.GQ[k]);
+        if(DP!=0 && DP>=minDP && GQ>=minGQ) W.FilterCounts[0]++;
+        tmpDP[k] = DP;
+        tmpGQ[k] = GQ;
+    }
+    GenotypeKernels::CountAtLeast(tmpDP.data(), nSamples, DPRlevel.data(), nDPR, W.FilterCounts.data()+1);
+    GenotypeKernels::CountAtLeast(tmpGQ.data(), nSamples, GQRlevel.data(), nGQR, W.FilterCounts.data()+1+nDPR);
+    int Check = RejectingFilter(W, nSamples, nSamples);
+    if(Check >= 0){
+        W.FilterRejections[Check]++;
+        if(Check==0) W.Status.RemovedGenotypeCallRate++;
+        else if(size_t(Check) <= nDPR) W.Status.RemovedDepthRate[Check-1]++;
+        else W.Status.RemovedQualityRate[Check-1-nDPR]++;
+        return false;
+    }
+    if(MAF<=0 || (Site.Flags & GenotypeCache::FLAG_BAD_AD)) return true;
+    /******* Cached AD already has one column per allele *******/
+    W.ADcolumns.assign(Site.AD, Site.AD+Site.Alleles*nSamples);
+    W.ADsums.assign(nSamples, 0);
+    for(size_t i(0); i < Site.Alleles; i++)
+        for(size_t k(0); k < nSamples; k++) W.ADsums[k] += W.ADcolumns[i*nSamples+k];
+    for(size_t k(0); k < nSamples; k++) if(Site.DP[k]==0) W.ADsums[k] = 0;
+    std::vector<double>& Alleles = W.SnpData.AlleleCountVector;
+    Alleles.resize(Site.Alleles);
+    for(size_t i(0); i < Site.Alleles; i++)
+        Alleles[i] = GenotypeKernels::SumFractions(&W.ADcolumns[i*nSamples], W.ADsums.data(), nSamples);
+    if(MinorAlleleShare(W)<MAF){
+        W.Status.RemovedMAF++;
+        return false;
+    }
+    return true;
+}
+int LCVCFtools::RejectingFilter(WorkerStruct& W, size_t Parsed, size_t Total){
+    /*************
+        Checks run in FilterOrder and stop at the first one that can
+        still change, a check fails for sure when it fails even if all
+        samples left pass it
+    *************/
+    const size_t Left = Total - Parsed;
+    for(size_t Check : W.FilterOrder){
+        double Threshold;
+        if(Check==0) Threshold = minGCR;
+        else if(Check <= DPRlevel.size()) Threshold = DPRvalue[Check-1];
+        else Threshold = GQRvalue[Check-1-DPRlevel.size()];
+        if(static_cast<double>(W.FilterCounts[Check]+Left)/Total < Threshold) return Check;
+        if(static_cast<double>(W.FilterCounts[Check])/Total < Threshold) return -1;
+    }
+    return -1;
+}
+void LCVCFtools::UpdateFilterOrder(WorkerStruct& W){
+    /*************
+        Stable insertion sort, std::stable_sort would allocate a
+        buffer for these few checks
+    *************/
+    if(!IsAdaptiveFilters || ++W.FilterSites % 1024) return;
+    std::vector<size_t>& Order = W.FilterOrder;
+    for(size_t i(1); i < Order.size(); i++){
+        size_t Check = Order[i], j = i;
+        for(; j > 0 && W.FilterRejections[Order[j-1]] < W.FilterRejections[Check]; j--) Order[j] = Order[j-1];
+        Order[j] = Check;
+    }
+}
+void LCVCFtools::DecodeSamples(WorkerStruct& W, WorkerStruct& Record, size_t Begin, size_t End, size_t* Counts){
+    /*************
+        Counts holds the samples passing minGCR, then every DPR and
+        GQR level, W only provides the record context so chunks of
+        one record can be decoded by several workers
+    *************/
+    std::vector<SampleDataStruct>& Samples = Record.SnpData.SampleDataVector;
+    std::vector<int> &tmpDP = Record.DPvalues, &tmpGQ = Record.GQvalues;
+    for(size_t k(Begin); k < End; k++){
+        SampleDataStruct& Sample = Samples[k];
+        int DP, GQ;
+        DecodeSample(W, Sample, DP, GQ);
+        if(DP==0){
+            Sample.IsMissingGT = true;
+            Sample.IsZeroed = true;
+            GQ = 0;
+        }
+        else{
+            /******* Apply minDP FILTER *******/
+            if(DP<minDP) Sample.IsMissingGT = true;
+            /******* Apply minGQ FILTER *******/
+            if(GQ<minGQ) Sample.IsMissingGT = true;
+            if(DP>=minDP && GQ>=minGQ) Counts[0]++;
+        }
+        tmpDP[k] = DP;
+        tmpGQ[k] = GQ;
+    }
+    /******* All rate levels are counted in one pass per metric *******/
+    GenotypeKernels::CountAtLeast(&tmpDP[Begin], End-Begin, DPRlevel.data(), DPRlevel.size(), Counts+1);
+    GenotypeKernels::CountAtLeast(&tmpGQ[Begin], End-Begin, GQRlevel.data(), GQRlevel.size(), Counts+1+DPRlevel.size());
+}
+bool LCVCFtools::Filter(WorkerStruct& W){
+    if(IsRemoveMultiallelic && W.SnpData.AlleleCountVector.size()>2) {
+        W.Status.RemovedMultiallelic++;
+        return false;
+    }
+    UpdateFilterOrder(W);
+    const size_t nSamples = W.SnpData.SampleDataVector.size();
+    const size_t nDPR = DPRlevel.size(), nGQR = GQRlevel.size();
+    W.DPvalues.resize(nSamples);
+    W.GQvalues.resize(nSamples);
+    W.FilterCounts.assign(1+nDPR+nGQR, 0);
+    /******* Apply minGCR, minDPR and minGQR FILTERS *******/
+    int Check = -1;
+    if(!SampleChunks.empty()){
+        RunChunks(CHUNK_SAMPLES);
+        for(const SampleChunkStruct& C : SampleChunks)
+            for(size_t i(0); i < C.FilterCounts.size(); i++) W.FilterCounts[i] += C.FilterCounts[i];
+        Check = RejectingFilter(W, nSamples, nSamples);
+    }
+    else for(size_t Begin(0); Begin < nSamples && Check < 0; Begin += 64){
+        const size_t End = std::min<size_t>(Begin+64, nSamples);
+        DecodeSamples(W, W, Begin, End, W.FilterCounts.data());
+        Check = RejectingFilter(W, End, nSamples);
+    }
+    if(Check >= 0){
+        W.FilterRejections[Check]++;
+        if(Check==0) W.Status.RemovedGenotypeCallRate++;
+        else if(size_t(Check) <= nDPR) W.Status.RemovedDepthRate[Check-1]++;
+        else W.Status.RemovedQualityRate[Check-1-nDPR]++;
+        return false;
+    }
+    W.SnpData.GCR = static_cast<double>(W.FilterCounts[0])/nSamples;
+    /******* Apply MAF FILTER *******/
+    if(MAF>0 && MinorAlleleFrequency(W)<MAF){
+        W.Status.RemovedMAF++;
+        return false;
+    }
+    /******* Update Sample Stats, chunks add theirs in OutputLine() *******/
+    if(IsSampleStats && SampleChunks.empty())
+        for(size_t i(0); i<nSamples; i++) W.SampleStats.Add(i, W.DPvalues[i], W.GQvalues[i]);
+    return true;
+}
@@ -0,0 +1,371 @@
+#include "index.h"
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+template<typename T> static void Append(std::string& Out, T Value){
+    for(size_t i(0); i < sizeof(T); i++) Out += char((static_cast<uint64_t>(Value) >> (8*i)) & 0xFF);
+}
+template<typename T> static T Extract(const std::string& In, size_t& Pos){
+    if(Pos + sizeof(T) > In.size()) throw std::runtime_error("Truncated index file");
+    uint64_t Value = 0;
+    for(size_t i(0); i < sizeof(T); i++) Value |= uint64_t(static_cast<unsigned char>(In[Pos+i])) << (8*i);
+    Pos += sizeof(T);
+    return static_cast<T>(Value);
+}
+TabixIndex::TabixIndex(bool IsCsi, int MinShift, int Depth) :
+    IsCsi(IsCsi), MinShift(IsCsi ? MinShift : 14), Depth(IsCsi ? Depth : 5){
+}
+int TabixIndex::DepthFor(uint64_t MaxLength, int MinShift){
+    int Depth = 0;
+    uint64_t Span = uint64_t(1) << MinShift;
+    while(Span < MaxLength){
+        Span <<= 3;
+        Depth++;
+    }
+    return Depth < 5 ? 5 : Depth;
+}
+uint32_t TabixIndex::Reg2Bin(int64_t Begin, int64_t End){
+    int l, s = MinShift, t = ((1 << Depth*3) - 1) / 7;
+    for(--End, l = Depth; l > 0; --l, s += 3, t -= 1 << l*3)
+        if(Begin >> s == End >> s) return t + (Begin >> s);
+    return 0;
+}
+uint32_t TabixIndex::BinFirstWindow(uint32_t Bin){
+    int l = 0;
+    for(uint32_t t = 0; ; l++){
+        uint32_t Next = t + (uint32_t(1) << 3*l);
+        if(Bin < Next) return (Bin - t) << 3*(Depth-l);
+        t = Next;
+    }
+}
+void TabixIndex::SaveChunk(){
+    if(CurrentRef < 0 || CurrentBin==UINT32_MAX) return;
+    std::vector<ChunkStruct>& Chunks = Refs[CurrentRef].Bins[CurrentBin];
+    if(!Chunks.empty() && Chunks.back().End==ChunkBegin) Chunks.back().End = ChunkEnd;
+    else Chunks.push_back({ChunkBegin, ChunkEnd});
+}
+bool TabixIndex::Push(const char* Line, size_t Size, uint64_t Begin, uint64_t End){
+    /*************
+        Columns CHROM, POS and REF, and END= from INFO when present
+    *************/
+    const char* Columns[9];
+    size_t nColumns = 0;
+    const char *p = Line, *LineEnd = Line + Size;
+    while(nColumns < 9 && p <= LineEnd){
+        Columns[nColumns++] = p;
+        const char* q = static_cast<const char*>(std::memchr(p, '\t', LineEnd-p));
+        if(!q) break;
+        p = q+1;
+    }
+    if(nColumns < 8) return false;
+    std::string Name(Columns[0], Columns[1]-Columns[0]-1);
+    int64_t RecordBegin = std::strtoll(Columns[1], nullptr, 10) - 1;
+    int64_t RecordEnd = RecordBegin + (Columns[4]-Columns[3]-1);
+    for(const char* Info = Columns[7]; Info < LineEnd && *Info!='\t'; ){
+        if(std::strncmp(Info, "END=", 4)==0){
+            int64_t tmpEnd = std::strtoll(Info+4, nullptr, 10);
+            if(tmpEnd > RecordBegin) RecordEnd = tmpEnd;
+            break;
+        }
+        while(Info < LineEnd && *Info!=';' && *Info!='\t') Info++;
+        if(Info < LineEnd && *Info==';') Info++;
+    }
+    if(RecordEnd <= RecordBegin) RecordEnd = RecordBegin + 1;
+    if(RecordBegin < 0 || (RecordEnd >> (MinShift + 3*Depth)) > 0) return false;
+    auto it = NameIndex.find(Name);
+    if(it==NameIndex.end()){
+        SaveChunk();
+        NameIndex[Name] = Names.size();
+        Names.push_back(Name);
+        Refs.push_back(RefStruct());
+        CurrentRef = Refs.size()-1;
+        CurrentBin = UINT32_MAX;
+        LastPos = -1;
+    }
+    else if(int(it->second)!=CurrentRef) return false;
+    if(RecordBegin < LastPos) return false;
+    LastPos = RecordBegin;
+    RefStruct& Ref = Refs[CurrentRef];
+    size_t WindowEnd = (RecordEnd-1) >> 14;
+    if(Ref.Linear.size() <= WindowEnd) Ref.Linear.resize(WindowEnd+1, UINT64_MAX);
+    for(size_t w = RecordBegin >> 14; w <= WindowEnd; w++)
+        if(Ref.Linear[w]==UINT64_MAX) Ref.Linear[w] = Begin;
+    uint32_t Bin = Reg2Bin(RecordBegin, RecordEnd);
+    if(Bin!=CurrentBin){
+        SaveChunk();
+        CurrentBin = Bin;
+        ChunkBegin = Begin;
+    }
+    ChunkEnd = End;
+    if(Ref.OffBegin==UINT64_MAX) Ref.OffBegin = Begin;
+    Ref.OffEnd = End;
+    Ref.nMapped++;
+    return true;
+}
+void TabixIndex::Save(const std::string& Filename, BgzfWriter& Data){
+    SaveChunk();
+    CurrentBin = UINT32_MAX;
+    std::string Out;
+    std::string Aux;
+    /*************
+        Tabix configuration: VCF preset, seq=1, begin=2, end=0, meta='#'
+    *************/
+    Append<int32_t>(Aux, 2);
+    Append<int32_t>(Aux, 1);
+    Append<int32_t>(Aux, 2);
+    Append<int32_t>(Aux, 0);
+    Append<int32_t>(Aux, '#');
+    Append<int32_t>(Aux, 0);
+    std::string NamesBlock;
+    for(const std::string& Name : Names) NamesBlock += Name + '\0';
+    Append<int32_t>(Aux, NamesBlock.size());
+    Aux += NamesBlock;
+    if(IsCsi){
+        Out += "CSI\1";
+        Append<int32_t>(Out, MinShift);
+        Append<int32_t>(Out, Depth);
+        Append<int32_t>(Out, Aux.size());
+        Out += Aux;
+        Append<int32_t>(Out, Refs.size());
+    }
+    else{
+        Out += "TBI\1";
+        Append<int32_t>(Out, Refs.size());
+        Out += Aux;
+    }
+    const uint32_t MetaBin = ((1 << (3*Depth+3)) - 1) / 7 + 1;
+    for(RefStruct& Ref : Refs){
+        uint64_t Previous = 0;
+        for(uint64_t& Offset : Ref.Linear){
+            if(Offset==UINT64_MAX) Offset = Previous;
+            else Offset = Data.VirtualOffset(Offset);
+            Previous = Offset;
+        }
+        Append<int32_t>(Out, Ref.Bins.size() + 1);
+        for(const auto& Bin : Ref.Bins){
+            Append<uint32_t>(Out, Bin.first);
+            if(IsCsi){
+                size_t Window = BinFirstWindow(Bin.first);
+                uint64_t LOffset = Window < Ref.Linear.size() ? Ref.Linear[Window] : Data.VirtualOffset(Bin.second.front().Begin);
+                Append<uint64_t>(Out, LOffset);
+            }
+            Append<int32_t>(Out, Bin.second.size());
+            for(const ChunkStruct& Chunk : Bin.second){
+                Append<uint64_t>(Out, Data.VirtualOffset(Chunk.Begin));
+                Append<uint64_t>(Out, Data.VirtualOffset(Chunk.End));
+            }
+        }
+        Append<uint32_t>(Out, MetaBin);
+        if(IsCsi) Append<uint64_t>(Out, 0);
+        Append<int32_t>(Out, 2);
+        Append<uint64_t>(Out, Data.VirtualOffset(Ref.OffBegin));
+        Append<uint64_t>(Out, Data.VirtualOffset(Ref.OffEnd));
+        Append<uint64_t>(Out, Ref.nMapped);
+        Append<uint64_t>(Out, 0);
+        if(!IsCsi){
+            Append<int32_t>(Out, Ref.Linear.size());
+            for(uint64_t Offset : Ref.Linear) Append<uint64_t>(Out, Offset);
+        }
+    }
+    Append<uint64_t>(Out, 0);
+    BgzfWriter Writer(Filename, 1);
+    if(!Writer.IsOpen()) throw std::runtime_error("Can't open index file " + Filename);
+    Writer.Write(Out.data(), Out.size());
+    Writer.Close();
+}
+void TabixIndex::SaveState(std::string& Out) const{
+    /*************
+        Offsets are kept as BgzfWriter positions, the state resumes
+        with a writer that restored its block offsets
+    *************/
+    Append<uint64_t>(Out, Names.size());
+    for(const std::string& Name : Names){
+        Append<uint64_t>(Out, Name.size());
+        Out += Name;
+    }
+    for(const RefStruct& Ref : Refs){
+        Append<uint64_t>(Out, Ref.Bins.size());
+        for(const auto& Bin : Ref.Bins){
+            Append<uint32_t>(Out, Bin.first);
+            Append<uint64_t>(Out, Bin.second.size());
+            for(const ChunkStruct& Chunk : Bin.second){
+                Append<uint64_t>(Out, Chunk.Begin);
+                Append<uint64_t>(Out, Chunk.End);
+            }
+        }
+        Append<uint64_t>(Out, Ref.LOffsets.size());
+        for(const auto& LOffset : Ref.LOffsets){
+            Append<uint32_t>(Out, LOffset.first);
+            Append<uint64_t>(Out, LOffset.second);
+        }
+        Append<uint64_t>(Out, Ref.Linear.size());
+        for(uint64_t Offset : Ref.Linear) Append<uint64_t>(Out, Offset);
+        Append<uint64_t>(Out, Ref.OffBegin);
+        Append<uint64_t>(Out, Ref.OffEnd);
+        Append<uint64_t>(Out, Ref.nMapped);
+    }
+    Append<int32_t>(Out, CurrentRef);
+    Append<int64_t>(Out, LastPos);
+    Append<uint32_t>(Out, CurrentBin);
+    Append<uint64_t>(Out, ChunkBegin);
+    Append<uint64_t>(Out, ChunkEnd);
+}
+void TabixIndex::LoadState(const std::string& In, size_t& Pos){
+    Names.resize(Extract<uint64_t>(In, Pos));
+    NameIndex.clear();
+    for(size_t i(0); i < Names.size(); i++){
+        size_t Size = Extract<uint64_t>(In, Pos);
+        if(Pos + Size > In.size()) throw std::runtime_error("Truncated index state");
+        Names[i] = In.substr(Pos, Size);
+        Pos += Size;
+        NameIndex[Names[i]] = i;
+    }
+    Refs.assign(Names.size(), RefStruct());
+    for(RefStruct& Ref : Refs){
+        for(size_t n = Extract<uint64_t>(In, Pos); n > 0; n--){
+            std::vector<ChunkStruct>& Chunks = Ref.Bins[Extract<uint32_t>(In, Pos)];
+            Chunks.resize(Extract<uint64_t>(In, Pos));
+            for(ChunkStruct& Chunk : Chunks){
+                Chunk.Begin = Extract<uint64_t>(In, Pos);
+                Chunk.End = Extract<uint64_t>(In, Pos);
+            }
+        }
+        for(size_t n = Extract<uint64_t>(In, Pos); n > 0; n--){
+            uint32_t Bin = Extract<uint32_t>(In, Pos);
+            Ref.LOffsets[Bin] = Extract<uint64_t>(In, Pos);
+        }
+        Ref.Linear.resize(Extract<uint64_t>(In, Pos));
+        for(uint64_t& Offset : Ref.Linear) Offset = Extract<uint64_t>(In, Pos);
+        Ref.OffBegin = Extract<uint64_t>(In, Pos);
+        Ref.OffEnd = Extract<uint64_t>(In, Pos);
+        Ref.nMapped = Extract<uint64_t>(In, Pos);
+    }
+    CurrentRef = Extract<int32_t>(In, Pos);
+    LastPos = Extract<int64_t>(In, Pos);
+    CurrentBin = Extract<uint32_t>(In, Pos);
+    ChunkBegin = Extract<uint64_t>(In, Pos);
+    ChunkEnd = Extract<uint64_t>(In, Pos);
+}
+bool TabixIndex::Load(const std::string& Filename){
+    std::ifstream File(Filename, std::ios_base::in | std::ios_base::binary);
+    if(!File.is_open()) return false;
+    std::string In;
+    {
+        BgzfReader Reader(File, 1);
+        char Buffer[1 << 16];
+        while(size_t n = Reader.Read(Buffer, sizeof(Buffer))) In.append(Buffer, n);
+    }
+    size_t Pos = 4;
+    std::vector<std::string> tmpNames;
+    auto ReadNames = [&](size_t End){
+        Pos += 6*sizeof(int32_t);
+        int32_t l_nm = Extract<int32_t>(In, Pos);
+        if(l_nm < 0 || Pos + l_nm > End) throw std::runtime_error("Invalid index names");
+        for(size_t i = Pos; i < Pos + l_nm; ){
+            size_t Nul = In.find('\0', i);
+            if(Nul==std::string::npos || Nul >= Pos + l_nm) break;
+            tmpNames.push_back(In.substr(i, Nul-i));
+            i = Nul+1;
+        }
+        Pos += l_nm;
+    };
+    int32_t n_ref;
+    if(In.compare(0, 4, "CSI\1")==0){
+        IsCsi = true;
+        MinShift = Extract<int32_t>(In, Pos);
+        Depth = Extract<int32_t>(In, Pos);
+        int32_t l_aux = Extract<int32_t>(In, Pos);
+        size_t AuxEnd = Pos + l_aux;
+        if(l_aux >= 28) ReadNames(AuxEnd);
+        Pos = AuxEnd;
+        n_ref = Extract<int32_t>(In, Pos);
+    }
+    else if(In.compare(0, 4, "TBI\1")==0){
+        IsCsi = false;
+        MinShift = 14;
+        Depth = 5;
+        n_ref = Extract<int32_t>(In, Pos);
+        ReadNames(In.size());
+    }
+    else throw std::runtime_error("Unknown index format in " + Filename);
+    const uint32_t MetaBin = ((1 << (3*Depth+3)) - 1) / 7 + 1;
+    Refs.assign(n_ref, RefStruct());
+    for(RefStruct& Ref : Refs){
+        int32_t n_bin = Extract<int32_t>(In, Pos);
+        for(int32_t i(0); i < n_bin; i++){
+            uint32_t Bin = Extract<uint32_t>(In, Pos);
+            uint64_t LOffset = IsCsi ? Extract<uint64_t>(In, Pos) : 0;
+            int32_t n_chunk = Extract<int32_t>(In, Pos);
+            std::vector<ChunkStruct> Chunks;
+            for(int32_t j(0); j < n_chunk; j++){
+                uint64_t Begin = Extract<uint64_t>(In, Pos);
+                uint64_t End = Extract<uint64_t>(In, Pos);
+                Chunks.push_back({Begin, End});
+            }
+            if(Bin==MetaBin) continue;
+            Ref.Bins[Bin] = std::move(Chunks);
+            if(IsCsi) Ref.LOffsets[Bin] = LOffset;
+        }
+        if(!IsCsi){
+            int32_t n_intv = Extract<int32_t>(In, Pos);
+            for(int32_t i(0); i < n_intv; i++) Ref.Linear.push_back(Extract<uint64_t>(In, Pos));
+        }
+    }
+    SetNames(tmpNames);
+    return true;
+}
+void TabixIndex::SetNames(const std::vector<std::string>& tmpNames){
+    Names = tmpNames;
+    NameIndex.clear();
+    for(size_t i(0); i < Names.size(); i++) NameIndex[Names[i]] = i;
+}
+int TabixIndex::RefIndex(const std::string& Name){
+    auto it = NameIndex.find(Name);
+    if(it==NameIndex.end() || it->second >= Refs.size()) return -1;
+    return it->second;
+}
+std::vector<TabixIndex::ChunkStruct> TabixIndex::Query(int Ref, int64_t Begin, int64_t End){
+    std::vector<ChunkStruct> Chunks;
+    if(Ref < 0 || size_t(Ref) >= Refs.size()) return Chunks;
+    const int64_t MaxPos = int64_t(1) << (MinShift + 3*Depth);
+    if(Begin < 0) Begin = 0;
+    if(End > MaxPos) End = MaxPos;
+    if(Begin >= End) return Chunks;
+    RefStruct& R = Refs[Ref];
+    /*************
+        Smallest offset of records overlapping Begin
+    *************/
+    uint64_t MinOffset = 0;
+    if(!IsCsi){
+        if(!R.Linear.empty()) MinOffset = R.Linear[std::min<size_t>(Begin >> 14, R.Linear.size()-1)];
+    }
+    else{
+        for(uint32_t Bin = Reg2Bin(Begin, Begin+1); ; Bin = (Bin-1) >> 3){
+            auto it = R.LOffsets.find(Bin);
+            if(it!=R.LOffsets.end()){
+                MinOffset = it->second;
+                break;
+            }
+            if(Bin==0) break;
+        }
+    }
+    int l, s = MinShift + 3*Depth, t = 0;
+    for(l = 0; l <= Depth; s -= 3, t += 1 << 3*l, l++){
+        uint32_t First = t + (Begin >> s), Last = t + ((End-1) >> s);
+        for(auto it = R.Bins.lower_bound(First); it!=R.Bins.end() && it->first <= Last; ++it)
+            for(const ChunkStruct& Chunk : it->second)
+                if(Chunk.End > MinOffset) Chunks.push_back(Chunk);
+    }
+    MergeChunks(Chunks);
+    return Chunks;
+}
+void TabixIndex::MergeChunks(std::vector<ChunkStruct>& Chunks){
+    std::sort(Chunks.begin(), Chunks.end(), [](const ChunkStruct& a, const ChunkStruct& b){return a.Begin < b.Begin;});
+    size_t n = 0;
+    for(const ChunkStruct& Chunk : Chunks){
+        if(n && Chunk.Begin <= Chunks[n-1].End) Chunks[n-1].End = std::max(Chunks[n-1].End, Chunk.End);
+        else Chunks[n++] = Chunk;
+    }
+    Chunks.resize(n);
+}
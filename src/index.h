@@ -0,0 +1,59 @@
+#ifndef INDEX_H
+#define INDEX_H
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "bgzf.h"
+/*************
+    Tabix (.tbi) and coordinate-sorted (.csi) indexes for BGZF VCF.
+    Both use the UCSC binning scheme, TBI is fixed to MinShift=14 and
+    Depth=5 (positions < 2^29) and also keeps a 16kb linear index.
+*************/
+class TabixIndex
+{
+public:
+    struct ChunkStruct{
+        uint64_t Begin, End;
+    };
+    TabixIndex(bool IsCsi = false, int MinShift = 14, int Depth = 5);
+    static int DepthFor(uint64_t MaxLength, int MinShift = 14);
+    bool Push(const char* Line, size_t Size, uint64_t Begin, uint64_t End);
+    void Save(const std::string& Filename, BgzfWriter& Data);
+    bool Load(const std::string& Filename);
+    void SaveState(std::string& Out) const;
+    void LoadState(const std::string& In, size_t& Pos);
+    void SetNames(const std::vector<std::string>& tmpNames);
+    int RefIndex(const std::string& Name);
+    std::vector<ChunkStruct> Query(int Ref, int64_t Begin, int64_t End);
+    static void MergeChunks(std::vector<ChunkStruct>& Chunks);
+private:
+    struct RefStruct{
+        std::map<uint32_t,std::vector<ChunkStruct>> Bins;
+        std::map<uint32_t,uint64_t> LOffsets;
+        std::vector<uint64_t> Linear;
+        uint64_t OffBegin = UINT64_MAX, OffEnd = 0, nMapped = 0;
+    };
+    /*************
+        FUNCTIONS
+    *************/
+    uint32_t Reg2Bin(int64_t Begin, int64_t End);
+    uint32_t BinFirstWindow(uint32_t Bin);
+    void SaveChunk();
+    /*************
+        INDEX
+    *************/
+    bool IsCsi;
+    int MinShift, Depth;
+    std::vector<std::string> Names;
+    std::map<std::string,size_t> NameIndex;
+    std::vector<RefStruct> Refs;
+    /*************
+        CURRENT CHUNK
+    *************/
+    int CurrentRef = -1;
+    int64_t LastPos = -1;
+    uint32_t CurrentBin = UINT32_MAX;
+    uint64_t ChunkBegin = 0, ChunkEnd = 0;
+};
+#endif
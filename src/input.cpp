@@ -0,0 +1,456 @@
+#include "lcvcftools.h"
+void LCVCFtools::ReadRemoveList(std::string Filename){
+    if(Filename.empty()) return;
+    std::ifstream File(Filename);
+    if(!File.is_open()) Terminate("Remove list file does not exist or is not readable.");
+    while(true){
+        std::string tmpString;
+        if(!std::getline(File, tmpString)) break;
+        if(!tmpString.empty()) RemoveSamples.insert(tmpString);
+    }
+}
+void LCVCFtools::ReadKeepList(std::string Filename){
+    if(Filename.empty()) return;
+    std::ifstream File(Filename);
+    if(!File.is_open()) Terminate("Keep list file does not exist or is not readable.");
+    while(true){
+        std::string tmpString;
+        if(!std::getline(File, tmpString)) break;
+        if(!tmpString.empty()) KeepSamples.insert(tmpString);
+    }
+}
+void LCVCFtools::AddRegion(std::string Region){
+    /*************
+        Stored 0-based half-open, chr:pos is a single position
+        and chr:start- runs to the end of the contig
+    *************/
+    Region.erase(std::remove(Region.begin(), Region.end(), ','), Region.end());
+    int64_t Begin = 0, End = INT64_MAX;
+    size_t Colon = Region.rfind(':');
+    if(Colon!=std::string::npos){
+        std::string Range = Region.substr(Colon+1);
+        size_t Dash = Range.find('-');
+        try{
+            size_t n;
+            Begin = std::stoll(Range.substr(0, Dash), &n);
+            if(n!=Range.substr(0, Dash).size()) throw std::invalid_argument(Range);
+            if(Dash==std::string::npos) End = Begin;
+            else if(Dash+1 < Range.size()){
+                End = std::stoll(Range.substr(Dash+1), &n);
+                if(n!=Range.size()-Dash-1) throw std::invalid_argument(Range);
+            }
+        }
+        catch(const std::logic_error&){
+            Terminate("Invalid region '" + Region + "'");
+        }
+        if(Begin < 1 || End < Begin) Terminate("Invalid region '" + Region + "'");
+        Begin--;
+        Region.erase(Colon);
+    }
+    if(Region.empty()) Terminate("Invalid region, missing contig name");
+    RegionMap[Region].emplace_back(Begin, End);
+    IsRegions = true;
+}
+void LCVCFtools::ReadRegionsFile(std::string Filename){
+    std::ifstream File(Filename);
+    if(!File.is_open()) Terminate("Regions file does not exist or is not readable.");
+    std::string tmpString;
+    while(std::getline(File, tmpString)){
+        if(!tmpString.empty() && tmpString.back()=='\r') tmpString.pop_back();
+        if(tmpString.empty() || tmpString[0]=='#') continue;
+        std::vector<std::string> tmpFields;
+        boost::split(tmpFields, tmpString, boost::algorithm::is_any_of("\t"));
+        if(tmpFields.size()==1) AddRegion(tmpFields[0]);
+        else if(tmpFields.size()==2) AddRegion(tmpFields[0] + ":" + tmpFields[1]);
+        else AddRegion(tmpFields[0] + ":" + tmpFields[1] + "-" + tmpFields[2]);
+    }
+    if(!IsRegions) Terminate("No regions in regions file.");
+}
+void LCVCFtools::OpenRegions(){
+    if(!IsRegions) return;
+    for(auto& Contig : RegionMap){
+        std::vector<std::pair<int64_t,int64_t>>& Ranges = Contig.second;
+        std::sort(Ranges.begin(), Ranges.end());
+        size_t n = 0;
+        for(const auto& Range : Ranges){
+            if(n && Range.first <= Ranges[n-1].second) Ranges[n-1].second = std::max(Ranges[n-1].second, Range.second);
+            else Ranges[n++] = Range;
+        }
+        Ranges.resize(n);
+    }
+    /*************
+        Seek with an index when the input is a BGZF file,
+        records are still checked against the regions
+    *************/
+    if(!IsFile || !Bgzf){
+        Log("Scanning the whole input for regions...");
+        return;
+    }
+    TabixIndex tmpIndex;
+    std::string IndexFilename;
+    try{
+        for(const char* Extension : {".csi", ".tbi"}){
+            if(tmpIndex.Load(InputFilename + Extension)){
+                IndexFilename = InputFilename + Extension;
+                break;
+            }
+        }
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+    if(IndexFilename.empty()){
+        Log("No .tbi/.csi index found, scanning the whole input for regions...");
+        return;
+    }
+    if(IsBcf) tmpIndex.SetNames(Bcf.Contigs);
+    for(const auto& Contig : RegionMap){
+        int Ref = tmpIndex.RefIndex(Contig.first);
+        if(Ref < 0) continue;
+        for(const auto& Range : Contig.second){
+            std::vector<TabixIndex::ChunkStruct> tmpChunks = tmpIndex.Query(Ref, Range.first, Range.second);
+            RegionChunks.insert(RegionChunks.end(), tmpChunks.begin(), tmpChunks.end());
+        }
+    }
+    TabixIndex::MergeChunks(RegionChunks);
+    IsIndexed = true;
+    Log("Using index " + IndexFilename + ", " + std::to_string(RegionChunks.size()) + " chunk(s) to read...");
+}
+bool LCVCFtools::IsInRegions(boost::string_view Record){
+    std::string Contig;
+    int64_t Begin, End;
+    if(IsBcf){
+        int32_t Values[3];
+        if(Record.size() < 20) return false;
+        std::memcpy(Values, Record.data()+8, 12);
+        if(Values[0] < 0 || size_t(Values[0]) >= Bcf.Contigs.size()) return false;
+        Contig = Bcf.Contigs[Values[0]];
+        Begin = Values[1];
+        End = Begin + std::max(Values[2], 1);
+    }
+    else{
+        const char* p = Record.data();
+        const char* Last = p + Record.size();
+        const char* Tab[4];
+        for(int i(0); i < 4; i++){
+            Tab[i] = static_cast<const char*>(std::memchr(p, '\t', Last-p));
+            if(!Tab[i]) return false;
+            p = Tab[i]+1;
+        }
+        Contig.assign(Record.data(), Tab[0]);
+        Begin = std::strtoll(Tab[0]+1, nullptr, 10) - 1;
+        End = Begin + std::max<int64_t>(Tab[3]-Tab[2]-1, 1);
+    }
+    auto it = RegionMap.find(Contig);
+    if(it==RegionMap.end()) return false;
+    const std::vector<std::pair<int64_t,int64_t>>& Ranges = it->second;
+    auto Range = std::upper_bound(Ranges.begin(), Ranges.end(), std::make_pair(Begin, INT64_MAX));
+    if(Range!=Ranges.end() && Range->first < End) return true;
+    return Range!=Ranges.begin() && (--Range)->second > Begin;
+}
+void LCVCFtools::OpenInputStream(){
+    //          Copyright Joe Coder 2004 - 2006.
+    // Distributed under the Boost Software License, Version 1.0.
+    //    (See accompanying file BOOST.license or copy at
+    //          https://www.boost.org/LICENSE_1_0.txt)
+    if(IsFile){
+        if(IsGzipped || IsBcf){
+            file.open(InputFilename, std::ios_base::in | std::ios_base::binary);
+            if(!file.is_open()) Terminate("VCF file does not exist or is not readable");
+            char Header[BgzfReader::HeaderSize];
+            file.read(Header, sizeof(Header));
+            size_t HeaderSize = file.gcount();
+            file.clear();
+            file.seekg(0, std::ios_base::beg);
+            if(BgzfReader::IsBgzf(Header, HeaderSize)){
+                Log("BGZF input detected, decompressing with " + std::to_string(Threads) + " thread(s)...");
+                Bgzf.reset(new BgzfReader(file, Threads));
+            }
+            else if(IsGzipped || (HeaderSize >= 2 && Header[0]=='\x1f' && Header[1]=='\x8b')){
+                IsGzipped = true;
+                in.push(boost::iostreams::gzip_decompressor());
+                in.push(file);
+            }
+        }
+        else{
+            /*************
+                Plain files are mapped, pipes and other special
+                files fall back to a stream
+            *************/
+            try{
+                Mapped.reset(new MappedReader(InputFilename));
+                filesize = Mapped->Size();
+                return;
+            }
+            catch(const std::runtime_error&){
+                file.open(InputFilename);
+                if(!file.is_open()) Terminate("VCF file does not exist or is not readable");
+            }
+        }
+    }
+    else{
+        if(!IsGzipped && !IsBcf){
+            try{
+                Buffered.reset(new BufferedReader(STDIN_FILENO));
+            }
+            catch(const std::runtime_error& e){
+                Terminate(e.what());
+            }
+        }
+        if(IsGzipped || IsBcf){
+            /*************
+                stdin can't be rewound, replay the detection bytes
+            *************/
+            std::string Header(BgzfReader::HeaderSize, '\0');
+            std::cin.read(&Header[0], Header.size());
+            Header.resize(std::cin.gcount());
+            if(BgzfReader::IsBgzf(Header.data(), Header.size())){
+                Log("BGZF input detected, decompressing with " + std::to_string(Threads) + " thread(s)...");
+                Bgzf.reset(new BgzfReader(std::cin, Threads, Header));
+            }
+            else{
+                if(IsGzipped || (Header.size() >= 2 && Header[0]=='\x1f' && Header[1]=='\x8b')){
+                    IsGzipped = true;
+                    in.push(boost::iostreams::gzip_decompressor());
+                }
+                in.push(PrefixedSource(std::cin, Header));
+            }
+        }
+    }
+    file.seekg(0,std::ios_base::end);
+    filesize=file.tellg();
+    file.seekg(0,std::ios_base::beg);
+}
+bool LCVCFtools::GetLine(std::string& TmpString){
+    if(Mapped) return Mapped->GetLine(TmpString);
+    if((Bgzf && !IsBcf) || Buffered){
+        try{
+            return Bgzf ? Bgzf->GetLine(TmpString) : Buffered->GetLine(TmpString);
+        }
+        catch(const std::runtime_error& e){
+            Terminate(e.what());
+        }
+    }
+    if(IsBcf) return GetBcfRecord(TmpString);
+    if(!std::getline(InputStream(), TmpString, '\n')) return false;
+    return true;
+}
+bool LCVCFtools::GetRecord(boost::string_view& Record, std::string& TmpString){
+    if(Cache) return GetCachedRecord(Record, TmpString);
+    while(true){
+        if(IsIndexed){
+            try{
+                uint64_t Offset = Bgzf->Tell();
+                while(ChunkIndex < RegionChunks.size() && Offset >= RegionChunks[ChunkIndex].End) ChunkIndex++;
+                if(ChunkIndex >= RegionChunks.size()) return false;
+                if(Offset < RegionChunks[ChunkIndex].Begin) Bgzf->Seek(RegionChunks[ChunkIndex].Begin);
+            }
+            catch(const std::runtime_error& e){
+                Terminate(e.what());
+            }
+        }
+        if(Mapped){
+            if(!Mapped->GetLine(Record)) return false;
+        }
+        else{
+            if(!GetLine(TmpString)) return false;
+            Record = TmpString;
+        }
+        if(!IsRegions || IsInRegions(Record)) return true;
+    }
+}
+bool LCVCFtools::GetCachedRecord(boost::string_view& Record, std::string& TmpString){
+    /*************
+        Sites rejected from the cached arrays are only counted, the
+        others are read back from their offset and filtered as usual
+    *************/
+    WorkerStruct& W = CacheWorker;
+    GenotypeCache::SiteStruct Site;
+    bool IsFound = false;
+    try{
+        while(Cache->Next(Site)){
+            if(CacheFilter(W, Site)){
+                IsFound = true;
+                break;
+            }
+            W.Status.InputCounter++;
+        }
+        if(W.Status.InputCounter) FlushStatus(W.Status, Status);
+        if(!IsFound) return false;
+        if(Mapped){
+            Mapped->Seek(Site.Offset);
+            if(!Mapped->GetLine(Record)) Terminate("Cache file does not match the input");
+        }
+        else{
+            /*************
+                Nearby records are reached by reading on, so the
+                decompression read-ahead is kept
+            *************/
+            uint64_t Offset = Bgzf->Tell();
+            while(Offset < Site.Offset && (Site.Offset >> 16) - (Offset >> 16) <= CacheSkipBytes){
+                if(!Bgzf->GetLine(TmpString)) break;
+                Offset = Bgzf->Tell();
+            }
+            if(Offset!=Site.Offset) Bgzf->Seek(Site.Offset);
+            if(!Bgzf->GetLine(TmpString)) Terminate("Cache file does not match the input");
+            Record = TmpString;
+        }
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+    if(Record.size()!=Site.Length) Terminate("Cache file does not match the input");
+    return true;
+}
+void LCVCFtools::OpenCache(){
+    if(CacheFilename.empty()) return;
+    if(!Mapped && !(Bgzf && !IsBcf)) Terminate("A cache needs a plain or BGZF compressed VCF file as input");
+    if(IsBuildCache) return;
+    try{
+        Cache.reset(new CacheReader(CacheFilename));
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+    if(Cache->InputType()!=(Mapped ? GenotypeCache::INPUT_TEXT : GenotypeCache::INPUT_BGZF) || Cache->InputSize()!=filesize)
+        Terminate("Cache file was built from a different input");
+    if(Cache->Samples()!=HeaderSamples)
+        Terminate("Cache file samples differ from the input, build it with the same --keep/--remove");
+    /*************
+        DP and GQ are saturated in the cache, larger levels
+        can't be told apart
+    *************/
+    int MaxDP = minDP, MaxGQ = minGQ;
+    for(int Level : DPRlevel) MaxDP = std::max(MaxDP, Level);
+    for(int Level : GQRlevel) MaxGQ = std::max(MaxGQ, Level);
+    if(MaxDP > GenotypeCache::DecodeDepth(UINT16_MAX-1)) Terminate("DP levels above " + std::to_string(UINT16_MAX-1) + " can't be used with a cache");
+    if(MaxGQ > GenotypeCache::DecodeQuality(UINT8_MAX-1)) Terminate("GQ levels above " + std::to_string(UINT8_MAX-1) + " can't be used with a cache");
+    Log(std::to_string(Cache->Sites()) + " variants in cache file...");
+}
+size_t LCVCFtools::InputOffset(){
+    /*************
+        Compressed position for gzip/BGZF, the stream position
+        is read from the buffer since tellg() fails at EOF
+        and the finished bytes for a list
+    *************/
+    if(!ListFiles.empty()) return ListOffset;
+    if(Mapped) return Mapped->Tell();
+    if(Bgzf) return Bgzf->Tell() >> 16;
+    std::streamoff Offset = file.rdbuf()->pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+    return Offset < 0 ? filesize : Offset;
+}
+std::istream& LCVCFtools::InputStream(){
+    if(!in.empty()) return in;
+    if(IsFile) return file;
+    return std::cin;
+}
+size_t LCVCFtools::ReadBytes(char* Buffer, size_t Size){
+    if(Bgzf){
+        try{
+            return Bgzf->Read(Buffer, Size);
+        }
+        catch(const std::runtime_error& e){
+            Terminate(e.what());
+        }
+    }
+    InputStream().read(Buffer, Size);
+    return InputStream().gcount();
+}
+bool LCVCFtools::GetHeaderLine(std::string& TmpString){
+    if(!IsBcf) return GetLine(TmpString);
+    if(BcfHeaderLines.empty()) return false;
+    TmpString = std::move(BcfHeaderLines.front());
+    BcfHeaderLines.pop_front();
+    return true;
+}
+void LCVCFtools::ReadBcfHeader(){
+    char Magic[5];
+    if(ReadBytes(Magic, 5)!=5 || std::memcmp(Magic, "BCF\2", 4)!=0)
+        Terminate("Can't read BCF file, check the file format.");
+    if(Magic[4]!=2 && Magic[4]!=1) Terminate("Unsupported BCF version 2." + std::to_string(int(Magic[4])));
+    char Size[4];
+    if(ReadBytes(Size, 4)!=4) Terminate("Can't read BCF header.");
+    uint32_t l_text;
+    std::memcpy(&l_text, Size, 4);
+    std::string Text(l_text, '\0');
+    if(ReadBytes(&Text[0], l_text)!=l_text) Terminate("Can't read BCF header.");
+    Text.resize(std::strlen(Text.c_str()));
+    try{
+        Bcf.ReadHeaderText(Text);
+    }
+    catch(const std::exception& e){
+        Terminate(std::string("Invalid BCF header: ") + e.what());
+    }
+    Log(std::to_string(Bcf.Contigs.size()) + " contigs and " + std::to_string(Bcf.Strings.size()) + " FILTER/INFO/FORMAT keys in BCF header...");
+    boost::split(BcfHeaderLines, Text, boost::algorithm::is_any_of("\n"));
+    while(!BcfHeaderLines.empty() && BcfHeaderLines.back().empty()) BcfHeaderLines.pop_back();
+    for(std::string& Line : BcfHeaderLines){
+        size_t i = Line.find(",IDX=");
+        if(i==std::string::npos || Line.compare(0, 2, "##")!=0) continue;
+        Line.erase(i, Line.find_first_of(",>", i+1)-i);
+    }
+}
+bool LCVCFtools::GetBcfRecord(std::string& TmpString){
+    char Sizes[8];
+    size_t n = ReadBytes(Sizes, 8);
+    if(n==0) return false;
+    if(n!=8) Terminate("Truncated BCF record.");
+    uint32_t l_shared, l_indiv;
+    std::memcpy(&l_shared, Sizes, 4);
+    std::memcpy(&l_indiv, Sizes+4, 4);
+    TmpString.resize(8+size_t(l_shared)+l_indiv);
+    std::memcpy(&TmpString[0], Sizes, 8);
+    if(ReadBytes(&TmpString[8], TmpString.size()-8)!=TmpString.size()-8) Terminate("Truncated BCF record.");
+    return true;
+}
+void LCVCFtools::ReadHeader(){
+    if(IsBcf) ReadBcfHeader();
+    while(true){
+        std::string temp_string;
+        if(!GetHeaderLine(temp_string))
+            Terminate("Can't read VCF file, check the file format.");
+        if(temp_string[0]=='#'){
+            if(temp_string.substr(0,6)=="#CHROM"){
+                std::vector<std::string> tmpHeaderStrings;
+                boost::split(tmpHeaderStrings,temp_string,boost::algorithm::is_any_of("\t"));
+                std::vector<std::string> tmpHeaderStringsCheck ({"#CHROM","POS","ID","REF","ALT","QUAL","FILTER","INFO","FORMAT"});
+                for(size_t i(0); i<tmpHeaderStringsCheck.size();i++){
+                    if(tmpHeaderStrings[i]!=tmpHeaderStringsCheck[i])
+                        Terminate(tmpHeaderStrings[i] + " column must be " + tmpHeaderStringsCheck[i]);
+                    HeaderColumns.push_back(tmpHeaderStrings[i]);
+                }
+                tmpHeaderStrings.erase(tmpHeaderStrings.begin(),tmpHeaderStrings.begin()+9);
+                size_t i(0);
+                Log(std::to_string(tmpHeaderStrings.size()) + " samples identified...");
+                for(const std::string& tmpName : tmpHeaderStrings){
+                    bool Remove=false;
+                    if(!RemoveSamples.empty()){
+                        if(RemoveSamples.find(tmpName)!=RemoveSamples.end()) Remove=true;
+                    }
+                    if(!KeepSamples.empty()){
+                        if(KeepSamples.find(tmpName)==KeepSamples.end()) Remove=true;
+                    }
+                    if(!Remove){
+                        KeepColumns.push_back(i);
+                        HeaderSamples.push_back(tmpName);
+                    }
+                    i++;
+                }
+                InputSamples = i;
+                if(RemoveSamples.size()>0 || KeepSamples.size()>0)
+                    Log(std::to_string(HeaderSamples.size()) + " samples remaining after '--remove|--keep' applied...");
+                break;
+            }
+            CommentLines.push_back(temp_string);
+        }
+        else Terminate("VCF header without '#' starting character.");
+    }
+    if(!HeaderSamples.size()) Terminate("No samples in VCF file.");
+    if(ListParent && !ListParent->IsSameHeader(*this)) Terminate("Header columns or samples differ from the first listed file");
+    OpenCache();
+    OpenCheckpoint();
+    if(IsSweep || IsBuildCache || !OutputSuffix.empty()) return;
+    OpenOutputStream();
+    /******* A resumed output already has its header *******/
+    if(!IsResumed) OutputHeader();
+}
@@ -0,0 +1,161 @@
+#include "kernels.h"
+#include <algorithm>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+const size_t GenotypeKernels::LevelGroup;
+/*************
+    Sample k is summed in lane k%4, samples without a positive total
+    add nothing. Lanes are joined as (0+1)+(2+3).
+*************/
+static inline void SumLanes(const int* Values, const int* Totals, size_t Begin, size_t Size, double* Lane){
+    for(size_t k(Begin); k < Size; k++)
+        if(Totals[k] > 0) Lane[k%4] += static_cast<double>(Values[k])/Totals[k];
+}
+static inline double JoinLanes(const double* Lane){
+    return (Lane[0]+Lane[1])+(Lane[2]+Lane[3]);
+}
+void GenotypeKernels::CountScalar(const int* Values, size_t Size, const int* Levels, size_t nLevels, size_t* Counts){
+    for(size_t i(0); i < nLevels; i++){
+        size_t Count = 0;
+        for(size_t k(0); k < Size; k++) Count += (Values[k] >= Levels[i]);
+        Counts[i] += Count;
+    }
+}
+double GenotypeKernels::SumScalar(const int* Values, const int* Totals, size_t Size){
+    double Lane[4] = {0, 0, 0, 0};
+    SumLanes(Values, Totals, 0, Size, Lane);
+    return JoinLanes(Lane);
+}
+#ifdef KERNELS_X86
+/*************
+    Levels are taken LevelGroup at a time with one counter register
+    each, so the values are read once per group instead of once per
+    level. Registers count the values below each level, counters
+    are 32-bit as one call covers at most one site.
+*************/
+__attribute__((target("sse2")))
+void GenotypeKernels::CountSse2(const int* Values, size_t Size, const int* Levels, size_t nLevels, size_t* Counts){
+    for(size_t First(0); First < nLevels; First += LevelGroup){
+        const size_t nGroup = std::min(LevelGroup, nLevels-First);
+        __m128i Bound[LevelGroup], Acc[LevelGroup];
+        for(size_t i(0); i < nGroup; i++){
+            Bound[i] = _mm_set1_epi32(Levels[First+i]);
+            Acc[i] = _mm_setzero_si128();
+        }
+        size_t k = 0;
+        for(; k+4 <= Size; k += 4){
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Values+k));
+            for(size_t i(0); i < nGroup; i++) Acc[i] = _mm_sub_epi32(Acc[i], _mm_cmpgt_epi32(Bound[i], v));
+        }
+        for(size_t i(0); i < nGroup; i++){
+            uint32_t Lane[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(Lane), Acc[i]);
+            size_t Count = k - Lane[0] - Lane[1] - Lane[2] - Lane[3];
+            for(size_t j(k); j < Size; j++) Count += (Values[j] >= Levels[First+i]);
+            Counts[First+i] += Count;
+        }
+    }
+}
+__attribute__((target("avx2")))
+void GenotypeKernels::CountAvx2(const int* Values, size_t Size, const int* Levels, size_t nLevels, size_t* Counts){
+    for(size_t First(0); First < nLevels; First += LevelGroup){
+        const size_t nGroup = std::min(LevelGroup, nLevels-First);
+        __m256i Bound[LevelGroup], Acc[LevelGroup];
+        for(size_t i(0); i < nGroup; i++){
+            Bound[i] = _mm256_set1_epi32(Levels[First+i]);
+            Acc[i] = _mm256_setzero_si256();
+        }
+        size_t k = 0;
+        for(; k+8 <= Size; k += 8){
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Values+k));
+            for(size_t i(0); i < nGroup; i++) Acc[i] = _mm256_sub_epi32(Acc[i], _mm256_cmpgt_epi32(Bound[i], v));
+        }
+        for(size_t i(0); i < nGroup; i++){
+            uint32_t Lane[8];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(Lane), Acc[i]);
+            size_t Count = k;
+            for(uint32_t Value : Lane) Count -= Value;
+            for(size_t j(k); j < Size; j++) Count += (Values[j] >= Levels[First+i]);
+            Counts[First+i] += Count;
+        }
+    }
+}
+/*************
+    Totals that aren't positive become 1 with a zero value, so the
+    division is done for every lane and adds +0
+*************/
+__attribute__((target("sse2")))
+double GenotypeKernels::SumSse2(const int* Values, const int* Totals, size_t Size){
+    const __m128i Zero = _mm_setzero_si128(), One = _mm_set1_epi32(1);
+    __m128d Low = _mm_setzero_pd(), High = _mm_setzero_pd();
+    size_t k = 0;
+    for(; k+4 <= Size; k += 4){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Values+k));
+        __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Totals+k));
+        __m128i m = _mm_cmpgt_epi32(t, Zero);
+        v = _mm_and_si128(v, m);
+        t = _mm_or_si128(_mm_and_si128(t, m), _mm_andnot_si128(m, One));
+        Low = _mm_add_pd(Low, _mm_div_pd(_mm_cvtepi32_pd(v), _mm_cvtepi32_pd(t)));
+        High = _mm_add_pd(High, _mm_div_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(v, v)), _mm_cvtepi32_pd(_mm_unpackhi_epi64(t, t))));
+    }
+    double Lane[4];
+    _mm_storeu_pd(Lane, Low);
+    _mm_storeu_pd(Lane+2, High);
+    SumLanes(Values, Totals, k, Size, Lane);
+    return JoinLanes(Lane);
+}
+__attribute__((target("avx2")))
+double GenotypeKernels::SumAvx2(const int* Values, const int* Totals, size_t Size){
+    const __m128i Zero = _mm_setzero_si128(), One = _mm_set1_epi32(1);
+    __m256d Sum = _mm256_setzero_pd();
+    size_t k = 0;
+    for(; k+4 <= Size; k += 4){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Values+k));
+        __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Totals+k));
+        __m128i m = _mm_cmpgt_epi32(t, Zero);
+        v = _mm_and_si128(v, m);
+        t = _mm_blendv_epi8(One, t, m);
+        Sum = _mm256_add_pd(Sum, _mm256_div_pd(_mm256_cvtepi32_pd(v), _mm256_cvtepi32_pd(t)));
+    }
+    double Lane[4];
+    _mm256_storeu_pd(Lane, Sum);
+    SumLanes(Values, Totals, k, Size, Lane);
+    return JoinLanes(Lane);
+}
+#else
+void GenotypeKernels::CountSse2(const int* Values, size_t Size, const int* Levels, size_t nLevels, size_t* Counts){
+    CountScalar(Values, Size, Levels, nLevels, Counts);
+}
+void GenotypeKernels::CountAvx2(const int* Values, size_t Size, const int* Levels, size_t nLevels, size_t* Counts){
+    CountScalar(Values, Size, Levels, nLevels, Counts);
+}
+double GenotypeKernels::SumSse2(const int* Values, const int* Totals, size_t Size){
+    return SumScalar(Values, Totals, Size);
+}
+double GenotypeKernels::SumAvx2(const int* Values, const int* Totals, size_t Size){
+    return SumScalar(Values, Totals, Size);
+}
+#endif
+GenotypeKernels::KernelStruct GenotypeKernels::Select(){
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return KernelStruct{&CountAvx2, &SumAvx2, "AVX2"};
+    if(__builtin_cpu_supports("sse2")) return KernelStruct{&CountSse2, &SumSse2, "SSE2"};
+#endif
+    return KernelStruct{&CountScalar, &SumScalar, "scalar"};
+}
+const GenotypeKernels::KernelStruct& GenotypeKernels::Function(){
+    static const KernelStruct Selected = Select();
+    return Selected;
+}
+void GenotypeKernels::CountAtLeast(const int* Values, size_t Size, const int* Levels, size_t nLevels, size_t* Counts){
+    if(Size && nLevels) Function().Count(Values, Size, Levels, nLevels, Counts);
+}
+double GenotypeKernels::SumFractions(const int* Values, const int* Totals, size_t Size){
+    return Size ? Function().Sum(Values, Totals, Size) : 0;
+}
+std::string GenotypeKernels::Kernel(){
+    return Select().Name;
+}
@@ -0,0 +1,36 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+#include <string>
+#include <cstdint>
+#include <cstddef>
+/*************
+    Per-site genotype metrics over one value per sample (DP, GQ or one
+    allele of AD) stored contiguously, the widest kernel supported by
+    the CPU is selected at runtime. Every kernel sums fractions in the
+    same four lanes, so results don't depend on the CPU.
+*************/
+class GenotypeKernels
+{
+public:
+    static const size_t LevelGroup = 8;
+    static void CountAtLeast(const int* Values, size_t Size, const int* Levels, size_t nLevels, size_t* Counts);
+    static double SumFractions(const int* Values, const int* Totals, size_t Size);
+    static std::string Kernel();
+private:
+    typedef void (*CountFunction)(const int*, size_t, const int*, size_t, size_t*);
+    typedef double (*SumFunction)(const int*, const int*, size_t);
+    struct KernelStruct{
+        CountFunction Count;
+        SumFunction Sum;
+        const char* Name;
+    };
+    static KernelStruct Select();
+    static const KernelStruct& Function();
+    static void CountScalar(const int* Values, size_t Size, const int* Levels, size_t nLevels, size_t* Counts);
+    static void CountSse2(const int* Values, size_t Size, const int* Levels, size_t nLevels, size_t* Counts);
+    static void CountAvx2(const int* Values, size_t Size, const int* Levels, size_t nLevels, size_t* Counts);
+    static double SumScalar(const int* Values, const int* Totals, size_t Size);
+    static double SumSse2(const int* Values, const int* Totals, size_t Size);
+    static double SumAvx2(const int* Values, const int* Totals, size_t Size);
+};
+#endif
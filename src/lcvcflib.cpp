@@ -0,0 +1,21 @@
+#include "lcvcflib.h"
+#include "lcvcftools.h"
+LCVCFfilter::LCVCFfilter(const FilterConfig& Config) : Tools(new LCVCFtools(Config)){
+}
+LCVCFfilter::~LCVCFfilter(){
+}
+void LCVCFfilter::Run(){
+    Tools->Run();
+}
+void LCVCFfilter::Run(RecordCallback OnRecord, HeaderCallback OnHeader){
+    Tools->Run(OnRecord, OnHeader);
+}
+const std::vector<std::string>& LCVCFfilter::Samples() const{
+    return Tools->Samples();
+}
+size_t LCVCFfilter::InputRecords() const{
+    return Tools->InputRecords();
+}
+size_t LCVCFfilter::OutputRecords() const{
+    return Tools->OutputRecords();
+}
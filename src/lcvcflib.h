@@ -0,0 +1,26 @@
+#ifndef LCVCFLIB_H
+#define LCVCFLIB_H
+#include <memory>
+#include "config.h"
+/*************
+    Library entry point, the filter engine stays behind an opaque
+    pointer so programs only depend on FilterConfig and this class
+    and don't recompile when the engine changes.
+*************/
+class LCVCFtools;
+class LCVCFfilter
+{
+public:
+    explicit LCVCFfilter(const FilterConfig& Config);
+    ~LCVCFfilter();
+    LCVCFfilter(const LCVCFfilter&) = delete;
+    LCVCFfilter& operator=(const LCVCFfilter&) = delete;
+    void Run();
+    void Run(RecordCallback OnRecord, HeaderCallback OnHeader = HeaderCallback());
+    const std::vector<std::string>& Samples() const;
+    size_t InputRecords() const;
+    size_t OutputRecords() const;
+private:
+    std::unique_ptr<LCVCFtools> Tools;
+};
+#endif
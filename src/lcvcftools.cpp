@@ -1,172 +1,118 @@
 #include "lcvcftools.h"
 LCVCFtools::LCVCFtools(){
 }
-LCVCFtools::LCVCFtools(int argc, char* argv[]){
+LCVCFtools::LCVCFtools(const FilterConfig& Config){
+    ApplyConfig(Config);
+}
+void LCVCFtools::ApplyConfig(const FilterConfig& Config){
     /*************
-        Read Args
+        Checks the values, loads the sample, region and sweep files
+        and opens the input, errors are thrown as LCVCFerror
     *************/
-    std::vector<std::string> args;
-    for(int i(1); i < argc; i++) args.push_back(std::string(argv[i]));
-    SetParameters(args);
+    IsVerbose = Config.IsVerbose;
+    InputFilename = Config.InputFilename;
+    FilterConfig::FormatEnum Format = Config.Format;
+    OutputFilename = Config.OutputFilename;
+    OutputSuffix = Config.OutputSuffix;
+    if(!Config.ListFilename.empty()){
+        /******* The first listed file provides the header *******/
+        ReadListFile(Config.ListFilename);
+        InputFilename = ListFiles[0].Filename;
+        Format = ListFiles[0].Format;
+        ListConfig = Config;
+        if(!OutputFilename.empty() && !OutputSuffix.empty()) Terminate("out and out-suffix can't be used together");
+        if(!Config.SweepFilename.empty() || !Config.CacheFilename.empty()) Terminate("vcf-list can't be used with sweep or a cache");
+    }
+    else if(!OutputSuffix.empty()) Terminate("out-suffix can only be used with vcf-list");
+    IsFile = (InputFilename!="-");
+    IsGzipped = (Format==FilterConfig::FORMAT_GZVCF);
+    IsBcf = (Format==FilterConfig::FORMAT_BCF);
+    IsCsi = Config.IsCsi;
+    minDP = Config.minDP;
+    minGQ = Config.minGQ;
+    minGCR = Config.minGCR;
+    MAF = Config.MAF;
+    if(minGQ <= 0) Terminate("minGQ must be greater than 0");
+    if(minDP <= 0) Terminate("minDP must be greater than 0");
+    if(minGCR < 0 || minGCR > 1) Terminate("minGCR must be between 0 and 1");
+    if(MAF < 0 || MAF > 1) Terminate("MAF must be between 0 and 1");
+    if(Config.DPRlevel.size()!=Config.DPRvalue.size()) Terminate("minDPR levels and rates must have the same size");
+    if(Config.GQRlevel.size()!=Config.GQRvalue.size()) Terminate("minGQR levels and rates must have the same size");
+    for(size_t i(0); i < Config.DPRlevel.size(); i++){
+        if(Config.DPRlevel[i] < 0) Terminate("Level for minDPR must be greater than 0");
+        if(Config.DPRvalue[i] < 0 || Config.DPRvalue[i] > 1) Terminate("Rate for minDPR must be between 0 and 1");
+    }
+    for(size_t i(0); i < Config.GQRlevel.size(); i++){
+        if(Config.GQRlevel[i] < 0) Terminate("Level for minGQR must be greater than 0");
+        if(Config.GQRvalue[i] < 0 || Config.GQRvalue[i] > 1) Terminate("Rate for minGQR must be between 0 and 1");
+    }
+    DPRlevel = Config.DPRlevel;
+    DPRvalue = Config.DPRvalue;
+    GQRlevel = Config.GQRlevel;
+    GQRvalue = Config.GQRvalue;
+    Status.RemovedDepthRate.assign(DPRlevel.size(), 0);
+    Status.RemovedQualityRate.assign(GQRlevel.size(), 0);
+    IsRemoveMultiallelic = Config.IsRemoveMultiallelic;
+    IsAdaptiveFilters = Config.IsAdaptiveFilters;
+    IsID = Config.IsID;
+    if(Config.Threads < 1) Terminate("threads must be greater than 0");
+    Threads = Config.Threads;
+    IsSplitSamples = Config.IsSplitSamples;
+    IsSampleStats = Config.IsSampleStats;
+    YLim = Config.StatsLimit;
+    if(YLim <= 0) Terminate("stats-limit must be greater than 0");
+    IsStatsSketch = Config.IsStatsSketch;
+    IsMetrics = !Config.MetricsFilename.empty();
+    MetricsFilename = Config.MetricsFilename;
+    MetricsInterval = Config.MetricsInterval;
+    if(MetricsInterval <= 0) Terminate("metrics-interval must be greater than 0");
+    CheckpointFilename = Config.CheckpointFilename;
+    CheckpointInterval = Config.CheckpointInterval;
+    IsResume = Config.IsResume;
+    if(CheckpointInterval <= 0) Terminate("checkpoint-interval must be greater than 0");
+    if(IsResume && CheckpointFilename.empty()) Terminate("resume needs a checkpoint file");
+    if(!CheckpointFilename.empty() && (!Config.ListFilename.empty() || !Config.SweepFilename.empty() || !Config.CacheFilename.empty()))
+        Terminate("checkpoint can't be used with vcf-list, sweep or a cache");
+    CacheFilename = Config.CacheFilename;
+    IsBuildCache = Config.IsBuildCache;
+    if(IsBuildCache && CacheFilename.empty()) Terminate("build-cache needs a cache file name");
+    ReadRemoveList(Config.RemoveFilename);
+    ReadKeepList(Config.KeepFilename);
+    for(const std::string& Region : Config.Regions) AddRegion(Region);
+    if(!Config.RegionsFilename.empty()) ReadRegionsFile(Config.RegionsFilename);
+    IsSweep = !Config.SweepFilename.empty();
+    if(IsSweep) ReadSweepFile(Config.SweepFilename);
+    if(!CacheFilename.empty()){
+        if(IsSweep) Terminate("sweep can't be used with a cache");
+        if(IsRegions) Terminate("region and regions-file can't be used with a cache");
+        if(IsBuildCache && IsSampleStats) Terminate("sample-stats can't be used with build-cache");
+    }
     OpenInputStream();
     /*************
         Open statistics file
     *************/
-    if(IsSampleStats){
-        SampleStatsFile.open("stats1.tsv");
+    if(IsSampleStats && !Config.SampleStatsFilename.empty()){
+        SampleStatsFile.open(Config.SampleStatsFilename);
+        if(!SampleStatsFile.is_open()) Terminate("Can't write to " + Config.SampleStatsFilename);
         SampleStatsFile << std::scientific << std::setprecision(5);
     }
 }
-void LCVCFtools::ShowHelp(){
-    std::clog << "LCVCFtools Version " << THIS_VERSION << " is under GNU GPLv3.0\n" <<
-                 "Documentation and source code available at https://github.com/marcusnizalvarez/LCVCFtools\n"
-                 "If you would like more information, please contact me at marcus.alvarez@unesp.br\n"
-                 "\n"
-                 "[Input mode] \n"
-                 "--vcf    <STRING>       Read from VCF file. Use - to read from stdin.\n"
-                 "--gzvcf  <STRING>       Read from Gzip compressed VCF file. Use - to read from stdin.\n"
-                 "\n"
-                 "[Filter parameters] \n"
-                 "--minGQ  <INT>          Minimum genotype quality in PhredScale. [Default=20]\n"
-                 "--minDP  <INT>          Minimum depth. [Default=5]\n"
-                 "--MAF    <FLOAT>        Minor allele frequency, based on allele depth (AD). [Default=0.1]\n"
-                 "--minGCR <FLOAT>        Minimum Genotype Call rate. [Default=0]\n"
-                 "--minDPR <INT> <FLOAT>  Minimum Depth rate.\n"
-                 "--minGQR <INT> <FLOAT>  Minimum Genotype Quality rate.\n"
-                 "\n"
-                 "[Other arguments] \n"
-                 "--remove <STRING>       Remove samples listed in a file.\n"
-                 "--keep   <STRING>       Keep samples listed in a file, after --remove.\n"
-                 "--sample-stats          Output sample statistics to 'stats1.tsv'.\n"
-                 "--keep-multiallelic     Don't skip multiallelic (MAL) variants.\n"
-                 "--ID                    Generate generic ID, useful for programs like Plink.\n"
-                 "--verbose               Verbose mode.\n"
-                 "--help                  Print this message.\n"
-              << std::endl;
+const std::vector<std::string>& LCVCFtools::Samples() const{
+    return HeaderSamples;
 }
-void LCVCFtools::SetParameters(std::vector<std::string>& args){
-    if(args.empty()) {
-        ShowHelp();
-        throw 0;
-    }
-    for(size_t i(0); i < args.size(); i++){
-        if(args[i]=="--vcf"){
-            CheckARG("input");
-            if(++i >= args.size()) Terminate("Missing argument value for input file");
-            InputFilename = args[i];
-            if(InputFilename=="-") IsFile = false;
-            continue;
-        }
-        if(args[i]=="--gzvcf"){
-            CheckARG("input");
-            if(++i >= args.size()) Terminate("Missing argument value for input file");
-            InputFilename = args[i];
-            if(InputFilename=="-") IsFile = false;
-            IsGzipped = true;
-            continue;
-        }
-        if(args[i]=="--minGQ"){
-            CheckARG("minGQ");
-            if(++i >= args.size()) Terminate("Missing argument value for minGQ");
-            minGQ = std::stoi(args[i]);
-            if(minGQ <= 0) Terminate("minGQ must be greater than 0");
-            continue;
-        }
-        if(args[i]=="--minDP"){
-            CheckARG("minDP");
-            if(++i >= args.size()) Terminate("Missing argument value for minDP");
-            minDP = std::stoi(args[i]);
-            if(minDP <= 0) Terminate("minDP must be greater than 0");
-            continue;
-        }
-        if(args[i]=="--minGCR"){
-            CheckARG("minGCR");
-            if(++i >= args.size()) Terminate("Missing argument value for minGCR");
-            minGCR = std::stod(args[i]);
-            if(minGCR < 0 || minGCR > 1) Terminate("minGCR must be between 0 and 1");
-            continue;
-        }
-        if(args[i]=="--MAF"){
-            CheckARG("MAF");
-            if(++i >= args.size()) Terminate("Missing argument value for MAF");
-            MAF = std::stod(args[i]);
-            if(MAF < 0 || MAF > 1) Terminate("MAF must be between 0 and 1");
-            continue;
-        }
-        if(args[i]=="--minDPR"){
-            CheckARG("minDPR", false);
-            if(i+2 >= args.size()) Terminate("Missing arguments value for minDPR");
-            if(std::stoi(args[i+1]) < 0) Terminate("Level for minDPR must be greater than 0");
-            if(std::stod(args[i+2]) < 0 || std::stod(args[i+2]) > 1) Terminate("Rate for minDPR must be between 0 and 1");
-            DPRlevel.push_back(std::stoi(args[++i]));
-            DPRvalue.push_back(std::stod(args[++i]));
-            RemovedDepthRate.push_back(0);
-            continue;
-        }
-        if(args[i]=="--minGQR"){
-            CheckARG("minGQR", false);
-            if(i+2 >= args.size()) Terminate("Missing arguments value for minGQR");
-            if(std::stoi(args[i+1]) < 0) Terminate("Level for minGQR must be greater than 0");
-            if(std::stod(args[i+2]) < 0 || std::stod(args[i+2]) > 1) Terminate("Rate for minGQR must be between 0 and 1");
-            GQRlevel.push_back(std::stoi(args[++i]));
-            GQRvalue.push_back(std::stod(args[++i]));
-            RemovedQualityRate.push_back(0);
-            continue;
-        }
-        if(args[i]=="--sample-stats"){
-            CheckARG("sample-stats");
-            IsSampleStats = true;
-            continue;
-        }
-        if(args[i]=="--keep-multiallelic"){
-            CheckARG("keep-multiallelic");
-            IsRemoveMultiallelic = false;
-            continue;
-        }
-        if(args[i]=="--ID"){
-            CheckARG("ID");
-            IsID = true;
-            continue;
-        }
-        if(args[i]=="--remove"){
-            CheckARG("remove");
-            if(++i >= args.size()) Terminate("Missing argument value for remove");
-            ReadRemoveList(args[i]);
-            continue;
-        }
-        if(args[i]=="--keep"){
-            CheckARG("keep");
-            if(++i >= args.size()) Terminate("Missing argument value for remove");
-            ReadKeepList(args[i]);
-            continue;
-        }
-        if(args[i]=="--verbose"){
-            CheckARG("verbose");
-            IsVerbose=true;
-            continue;
-        }
-        if(args[i]=="--help"){
-            ShowHelp();
-            throw 0;
-        }
-        Terminate(args[i] + " is an invalid argument");
-    }
-    if(DefinedArguments.find("input")==DefinedArguments.end())
-        Terminate("Missing input mode argument");
-}
-int LCVCFtools::StringToInt(const std::string &String){
-    if(String.find('.')!=std::string::npos) return -1;
-    return std::stoi(String);
+size_t LCVCFtools::InputRecords() const{
+    return Status.InputCounter;
 }
-void LCVCFtools::CheckARG(std::string Argument, bool IsUnique){
-    if(IsUnique)
-        if(DefinedArguments.find(Argument)!=DefinedArguments.end())
-            Terminate("Multiple " + Argument + " definition");
-    DefinedArguments.insert(Argument);
+size_t LCVCFtools::OutputRecords() const{
+    return Status.OutputCounter;
 }
 void LCVCFtools::Log(std::string Msg){
     if(IsVerbose) std::clog << NowString() << Msg << std::endl;
 }
+void LCVCFtools::Warn(std::string Msg){
+    /******* Shown without --verbose too *******/
+    std::clog << NowString() << "\033[1;33m**WARNING** " << Msg << "\033[0m" << std::endl;
+}
 std::string LCVCFtools::NowString(){
     time_t rawtime;
     struct tm * timeinfo;
@@ -176,82 +122,6 @@ std::string LCVCFtools::NowString(){
     strftime(buffer,sizeof(buffer),"%d-%m-%Y %H:%M:%S",timeinfo);
     return(std::string("[") + buffer + "] ");
 }
-bool LCVCFtools::StringToVcf(const std::string& tmpLineString){
-    std::vector<std::string> tmpStrings;
-    boost::split(tmpStrings, tmpLineString, boost::algorithm::is_any_of("\t"));
-    if(tmpStrings.size()<9) Terminate("Invalid number of columns");
-    tmpSnpData.CHR=tmpStrings[0];
-    tmpSnpData.POS=tmpStrings[1];
-    tmpSnpData.ID=tmpStrings[2];
-    tmpSnpData.REF=tmpStrings[3];
-    tmpSnpData.ALT=tmpStrings[4];
-    tmpSnpData.QUAL=tmpStrings[5];
-    tmpSnpData.FILTER=tmpStrings[6];
-    tmpSnpData.INFO=tmpStrings[7];
-    tmpSnpData.FORMATstr=tmpStrings[8];
-    if(lastFORMATstr!=tmpSnpData.FORMATstr){
-        FORMATtagsMap.clear();
-        FORMATtagsVector.clear();
-        size_t i = 0;
-        std::set<std::string> RequiredTags = {"GQ","DP","AD","GT","PL"};
-        std::vector<std::string> tmpStrings2;
-        boost::split(tmpStrings2, tmpSnpData.FORMATstr, boost::algorithm::is_any_of(":"));
-        for(const std::string& String : tmpStrings2){
-            FORMATtagsVector.push_back(String);
-            FORMATtagsMap[String] = i++;
-            RequiredTags.erase(String);
-        }
-        if(!RequiredTags.empty()){
-            std::string tmpMsg = "Missing VCF required tag(s): ";
-            for(std::string s : RequiredTags) tmpMsg += s + "; ";
-            Terminate(tmpMsg);
-        }
-    }
-    lastFORMATstr = tmpSnpData.FORMATstr;
-    tmpStrings.erase(tmpStrings.begin(), tmpStrings.begin()+9);
-    tmpSnpData.SampleDataVector.reserve(tmpStrings.size());
-    size_t i = 0;
-    for(const std::string& tmpString : tmpStrings){
-        SampleDataStruct tmpSample;
-        if(tmpString.empty()) return false;
-        if(RemoveIndex.find(i++)!=RemoveIndex.end()) continue;
-        boost::split(tmpSample.FORMAT,tmpString,boost::algorithm::is_any_of(":"));
-        if(tmpSample.FORMAT.size()!=FORMATtagsVector.size()) Terminate("Incorrect number of fields for FORMAT");
-        tmpSample.GT = &tmpSample.FORMAT[FORMATtagsMap["GT"]];
-        tmpSample.PL = &tmpSample.FORMAT[FORMATtagsMap["PL"]];
-        tmpSample.DP = &tmpSample.FORMAT[FORMATtagsMap["DP"]];
-        tmpSample.AD = &tmpSample.FORMAT[FORMATtagsMap["AD"]];
-        tmpSample.GQ = &tmpSample.FORMAT[FORMATtagsMap["GQ"]];
-        tmpSnpData.SampleDataVector.push_back(std::move(tmpSample));
-    }
-    {
-        std::vector<std::string> tmpStrings2;
-        boost::split(tmpStrings2, tmpSnpData.ALT,boost::algorithm::is_any_of(","));
-        for(size_t i(0); i < tmpStrings2.size()+1; i++)
-            tmpSnpData.AlleleCountVector.push_back(std::pair<short,double>(i,0));
-    }
-    return true;
-}
-void LCVCFtools::ReadRemoveList(std::string Filename){
-    if(Filename.empty()) return;
-    std::ifstream File(Filename);
-    if(!File.is_open()) Terminate("Remove list file does not exist or is not readable.");
-    while(true){
-        std::string tmpString;
-        if(!std::getline(File, tmpString)) break;
-        if(!tmpString.empty()) RemoveSamples.insert(tmpString);
-    }
-}
-void LCVCFtools::ReadKeepList(std::string Filename){
-    if(Filename.empty()) return;
-    std::ifstream File(Filename);
-    if(!File.is_open()) Terminate("Keep list file does not exist or is not readable.");
-    while(true){
-        std::string tmpString;
-        if(!std::getline(File, tmpString)) break;
-        if(!tmpString.empty()) KeepSamples.insert(tmpString);
-    }
-}
 std::string LCVCFtools::GetParametersString(){
     std::string tmpString;
     std::ostringstream sso;
@@ -266,346 +136,450 @@ std::string LCVCFtools::GetParametersString(){
     tmpString = sso.str();
     return tmpString;
 }
-void LCVCFtools::OpenInputStream(){
-    //          Copyright Joe Coder 2004 - 2006.
-    // Distributed under the Boost Software License, Version 1.0.
-    //    (See accompanying file BOOST.license or copy at
-    //          https://www.boost.org/LICENSE_1_0.txt)
-    if(IsFile){
-        if(IsGzipped){
-            file.open(InputFilename, std::ios_base::in | std::ios_base::binary);
-            if(!file.is_open()) Terminate("VCF file does not exist or is not readable");
-            in.push(boost::iostreams::gzip_decompressor());
-            in.push(file);
-        }
-        else{
-            file.open(InputFilename);
-            if(!file.is_open()) Terminate("VCF file does not exist or is not readable");
+void LCVCFtools::Terminate(std::string Msg){
+    if(!Msg.empty()) Log("\033[1;31m**ERROR** " + Msg + "\033[0m");
+    throw LCVCFerror(Msg);
+}
+void LCVCFtools::BuildCache(){
+    /*************
+        Every variant, multiallelic ones too, is stored with the
+        offset of its line so the cache serves any filter parameters
+    *************/
+    WorkerStruct& W = Workers[0];
+    const size_t nSamples = HeaderSamples.size();
+    std::vector<uint16_t> DP(nSamples), AD;
+    std::vector<uint8_t> GQ(nSamples);
+    size_t LineNumber = 0, tmpCounter = 0;
+    try{
+        CacheWriter Writer(CacheFilename, HeaderSamples, Mapped ? GenotypeCache::INPUT_TEXT : GenotypeCache::INPUT_BGZF, filesize);
+        while(true){
+            uint64_t Offset = Mapped ? Mapped->Tell() : Bgzf->Tell();
+            boost::string_view Record;
+            if(!GetRecord(Record, LineBuffer)) break;
+            LineNumber++;
+            if(!Record.empty() && Record[0]=='#') Terminate("Invalid line at "+std::to_string(LineNumber-1)+".");
+            W.SnpData = SnpDataStruct();
+            W.Status.InputCounter++;
+            if(!StringToVcf(W, Record)) Terminate("Failed to read data at line " + std::to_string(LineNumber)+", check the file format");
+            const std::vector<SampleDataStruct>& Samples = W.SnpData.SampleDataVector;
+            const size_t nAlleles = W.SnpData.AlleleCountVector.size();
+            if(nAlleles > UINT16_MAX) Terminate("Too many alleles at line " + std::to_string(LineNumber));
+            uint16_t Flags = 0;
+            AD.assign(nAlleles*nSamples, 0);
+            for(size_t k(0); k < nSamples; k++){
+                int tmpDP, tmpGQ;
+                DecodeSample(W, Samples[k], tmpDP, tmpGQ);
+                DP[k] = GenotypeCache::EncodeDepth(tmpDP);
+                GQ[k] = GenotypeCache::EncodeQuality(tmpGQ);
+                /******* AD is only read for DP!=0, as MinorAlleleFrequency() *******/
+                if(tmpDP==0 || (Flags & GenotypeCache::FLAG_BAD_AD)) continue;
+                W.ADvalues.clear();
+                if(!Samples[k].AD.empty()) ParseInts(Samples[k].AD.begin(), Samples[k].AD.end(), W.ADvalues);
+                if(W.ADvalues.size()!=nAlleles) Flags |= GenotypeCache::FLAG_BAD_AD;
+                for(size_t i(0); i < W.ADvalues.size() && !Flags; i++){
+                    if(W.ADvalues[i] < 0 || W.ADvalues[i] >= UINT16_MAX) Flags |= GenotypeCache::FLAG_BAD_AD;
+                    else AD[i*nSamples+k] = W.ADvalues[i];
+                }
+            }
+            Writer.Write(Offset, Record.size(), Flags, DP, GQ, AD, nAlleles);
+            if(++tmpCounter >= Verbosity){
+                tmpCounter = 0;
+                FlushStatus(W.Status, Status);
+                ShowProgress();
+            }
         }
+        FlushStatus(W.Status, Status);
+        Writer.Close();
+        Log(std::to_string(Writer.Sites()) + " variants written to cache file...");
     }
-    else{
-        if(IsGzipped){
-            in.push(boost::iostreams::gzip_decompressor());
-            in.push(std::cin);
-        }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
     }
-    file.seekg(0,std::ios_base::end);
-    filesize=file.tellg();
-    file.seekg(0,std::ios_base::beg);
 }
-void LCVCFtools::Terminate(std::string Msg){
-    if(!Msg.empty()) Log("\033[1;31m**ERROR** " + Msg + "\033[0m");
-    throw 1;
+void LCVCFtools::InitWorkers(){
+    Workers.resize(Threads);
+    std::vector<WorkerStruct*> tmpWorkers;
+    for(WorkerStruct& W : Workers) tmpWorkers.push_back(&W);
+    if(Cache) tmpWorkers.push_back(&CacheWorker);
+    for(WorkerStruct* tmpWorker : tmpWorkers){
+        WorkerStruct& W = *tmpWorker;
+        W.Status.RemovedDepthRate.resize(DPRlevel.size(), 0);
+        W.Status.RemovedQualityRate.resize(GQRlevel.size(), 0);
+        W.FilterOrder.resize(1+DPRlevel.size()+GQRlevel.size());
+        std::iota(W.FilterOrder.begin(), W.FilterOrder.end(), 0);
+        W.FilterRejections.assign(W.FilterOrder.size(), 0);
+        W.SweepStatus.resize(SweepGrid.size());
+        for(size_t c(0); c < SweepGrid.size(); c++){
+            W.SweepStatus[c].RemovedDepthRate.resize(SweepGrid[c].DPRlevel.size(), 0);
+            W.SweepStatus[c].RemovedQualityRate.resize(SweepGrid[c].GQRlevel.size(), 0);
+        }
+        /******* Sample chunks add their statistics to the record worker *******/
+        if(IsSampleStats && !(IsSplitSamples && tmpWorker!=&Workers[0])) W.SampleStats.Reset(HeaderSamples.size(), YLim, IsStatsSketch);
+    }
+    if(IsSampleStats) SampleStats.Reset(HeaderSamples.size(), YLim, IsStatsSketch);
 }
-bool LCVCFtools::GetLine(std::string& TmpString){
-    if(IsFile){
-        if(IsGzipped){
-            if(!std::getline(in, TmpString, '\n')) return false;
-        }
-        else{
-            if(!std::getline(file, TmpString, '\n')) return false;
-        }
+void LCVCFtools::FlushStatus(StatusStruct& Source, StatusStruct& Target){
+    Target.InputCounter += Source.InputCounter;
+    Target.OutputCounter += Source.OutputCounter;
+    Target.RemovedGenotypeCallRate += Source.RemovedGenotypeCallRate;
+    Target.RemovedMultiallelic += Source.RemovedMultiallelic;
+    Target.RemovedIndels += Source.RemovedIndels;
+    Target.RemovedMAF += Source.RemovedMAF;
+    Target.RemovedDepthRate.resize(Source.RemovedDepthRate.size(), 0);
+    Target.RemovedQualityRate.resize(Source.RemovedQualityRate.size(), 0);
+    for(size_t i(0); i < Source.RemovedDepthRate.size(); i++) Target.RemovedDepthRate[i] += Source.RemovedDepthRate[i];
+    for(size_t i(0); i < Source.RemovedQualityRate.size(); i++) Target.RemovedQualityRate[i] += Source.RemovedQualityRate[i];
+    Target.InputBytes += Source.InputBytes;
+    Target.OutputBytes += Source.OutputBytes;
+    for(size_t i(0); i < STAGE_COUNT; i++){
+        Target.StageWall[i] += Source.StageWall[i];
+        Target.StageCpu[i] += Source.StageCpu[i];
+    }
+    std::vector<size_t> tmpDepthRate, tmpQualityRate;
+    tmpDepthRate.swap(Source.RemovedDepthRate);
+    tmpQualityRate.swap(Source.RemovedQualityRate);
+    std::fill(tmpDepthRate.begin(), tmpDepthRate.end(), 0);
+    std::fill(tmpQualityRate.begin(), tmpQualityRate.end(), 0);
+    Source = StatusStruct();
+    Source.RemovedDepthRate.swap(tmpDepthRate);
+    Source.RemovedQualityRate.swap(tmpQualityRate);
+}
+void LCVCFtools::MergeSampleStatistics(){
+    if(!IsSampleStats) return;
+    for(WorkerStruct& W : Workers) if(W.SampleStats.Samples()) SampleStats.Merge(W.SampleStats);
+}
+void LCVCFtools::ProcessLine(WorkerStruct& W, boost::string_view tmpLineString, size_t LineNumber){
+    if(!IsBcf && !tmpLineString.empty() && tmpLineString[0]=='#') Terminate("Invalid line at "+std::to_string(LineNumber-1)+".");
+    StageClock Clock;
+    StatusStruct& S = W.Status;
+    if(IsMetrics) Clock.Reset();
+#ifdef LCVCF_CHECK_ALLOCATIONS
+    uint64_t Allocations = AllocationCounter::ThreadCount();
+    size_t OutputCapacity = W.Output.capacity(), CacheMisses = W.CacheMisses;
+#endif
+    W.SnpData.Reset();
+    W.Status.InputCounter++;
+    if(!(IsBcf ? BcfToVcf(W, tmpLineString) : StringToVcf(W, tmpLineString))) Terminate("Failed to read data at " + std::string(IsBcf ? "record " : "line ") + std::to_string(LineNumber)+", check the file format");
+    if(IsMetrics) Clock.Lap(S.StageWall[STAGE_TOKENIZE], S.StageCpu[STAGE_TOKENIZE]);
+    if(IsSweep){
+        SweepSite(W);
+        if(IsMetrics) Clock.Lap(S.StageWall[STAGE_FILTER], S.StageCpu[STAGE_FILTER]);
+    }
+    else if(Filter(W)){
+        if(IsMetrics) Clock.Lap(S.StageWall[STAGE_FILTER], S.StageCpu[STAGE_FILTER]);
+        W.Status.OutputCounter++;
+        OutputLine(W);
+        if(IsMetrics) Clock.Lap(S.StageWall[STAGE_SERIALIZE], S.StageCpu[STAGE_SERIALIZE]);
+    }
+    else if(IsMetrics) Clock.Lap(S.StageWall[STAGE_FILTER], S.StageCpu[STAGE_FILTER]);
+#ifdef LCVCF_CHECK_ALLOCATIONS
+    /*************
+        Debug builds count the sites a warmed up worker can't parse,
+        filter and format without touching the heap. Growing the
+        output buffer to a new high-water mark or a cache on a miss
+        is expected, the other sites are reported when the run ends.
+    *************/
+    if(++W.ProcessedSites > AllocationWarmup && W.Output.capacity()==OutputCapacity && W.CacheMisses==CacheMisses &&
+       AllocationCounter::ThreadCount()!=Allocations && W.AllocatingSites++==0)
+        W.FirstAllocatingLine = LineNumber;
+#endif
+}
+void LCVCFtools::ReadData(){
+    if(Threads > 1 && !IsSplitSamples){
+        ReadDataThreaded();
+        return;
+    }
+    if(Threads > 1) StartChunks();
+    try{
+        ReadRecords();
+    }
+    catch(...){
+        StopChunks();
+        throw;
     }
-    else{
-        if(IsGzipped){
-            if(!std::getline(in, TmpString, '\n')) return false;
+    StopChunks();
+}
+void LCVCFtools::ReadRecords(){
+    WorkerStruct& W = Workers[0];
+    size_t tmpCounter = 0;
+    size_t LineNumber = CheckpointLine;
+    StageClock Clock;
+    while(true){
+        boost::string_view Record;
+        if(IsMetrics) Clock.Reset();
+        if(!GetRecord(Record, LineBuffer)) break;
+        if(IsMetrics){
+            Clock.Lap(Status.StageWall[STAGE_READ], Status.StageCpu[STAGE_READ]);
+            Status.InputBytes += Record.size()+1;
+        }
+        ProcessLine(W, Record, ++LineNumber);
+        if(IsMetrics) Clock.Reset();
+        WriteOutput(W.Output);
+        if(IsMetrics){
+            Clock.Lap(Status.StageWall[STAGE_WRITE], Status.StageCpu[STAGE_WRITE]);
+            Status.OutputBytes += W.Output.size();
+        }
+        W.Output.clear();
+        bool IsDue = IsMetricsDue();
+        if(++tmpCounter >= Verbosity || IsDue){
+            tmpCounter = 0;
+            FlushStatus(W.Status, Status);
+            ShowProgress();
+            if(IsDue) EmitMetrics("running");
         }
-        else{
-            if(!std::getline(std::cin, TmpString, '\n')) return false;
+        if(IsCheckpointDue()){
+            FlushStatus(W.Status, Status);
+            SaveCheckpoint(LineNumber);
         }
     }
-    return true;
+    FlushStatus(W.Status, Status);
+    MergeSampleStatistics();
 }
-void LCVCFtools::ReadHeader(){
+void LCVCFtools::WorkerThread(WorkerStruct& W){
     while(true){
-        std::string temp_string;
-        if(!GetLine(temp_string))
-            Terminate("Can't read VCF file, check the file format.");
-        if(temp_string[0]=='#'){
-            if(temp_string.substr(0,6)=="#CHROM"){
-                std::vector<std::string> tmpHeaderStrings;
-                boost::split(tmpHeaderStrings,temp_string,boost::algorithm::is_any_of("\t"));
-                std::vector<std::string> tmpHeaderStringsCheck ({"#CHROM","POS","ID","REF","ALT","QUAL","FILTER","INFO","FORMAT"});
-                for(size_t i(0); i<tmpHeaderStringsCheck.size();i++){
-                    if(tmpHeaderStrings[i]!=tmpHeaderStringsCheck[i])
-                        Terminate(tmpHeaderStrings[i] + " column must be " + tmpHeaderStringsCheck[i]);
-                    HeaderColumns.push_back(tmpHeaderStrings[i]);
+        BatchStruct* Batch;
+        {
+            std::unique_lock<std::mutex> Lock(QueueMutex);
+            QueueCV.wait(Lock, [&]{return !WorkQueue.empty() || IsQueueClosed;});
+            if(WorkQueue.empty()) return;
+            Batch = WorkQueue.front();
+            WorkQueue.pop_front();
+        }
+        try{
+            for(size_t i(0); i < Batch->LineCount; i++)
+                ProcessLine(W, Batch->Records[i], Batch->FirstLine+i);
+        }
+        catch(...){
+            std::lock_guard<std::mutex> Lock(QueueMutex);
+            if(!WorkerError) WorkerError = std::current_exception();
+        }
+        /*************
+            Batches and workers trade output buffers, the worker keeps
+            at least the capacity of the one it hands over
+        *************/
+        std::swap(Batch->Output, W.Output);
+        W.Output.clear();
+        W.Output.reserve(Batch->Output.capacity());
+        FlushStatus(W.Status, Batch->Status);
+        {
+            std::lock_guard<std::mutex> Lock(QueueMutex);
+            Batch->IsDone = true;
+        }
+        DoneCV.notify_all();
+    }
+}
+void LCVCFtools::ReadDataThreaded(){
+    /*************
+        The main thread reads batches of lines and writes finished batches
+        in input order, workers parse and filter them in parallel
+    *************/
+    const size_t MaxInFlight = 4*Threads;
+    std::deque<std::unique_ptr<BatchStruct>> InFlight;
+    std::vector<std::unique_ptr<BatchStruct>> FreeBatches;
+    std::vector<std::thread> WorkerThreads;
+    for(WorkerStruct& W : Workers) WorkerThreads.emplace_back(&LCVCFtools::WorkerThread, this, std::ref(W));
+    auto StopWorkers = [&](){
+        {
+            std::lock_guard<std::mutex> Lock(QueueMutex);
+            IsQueueClosed = true;
+            WorkQueue.clear();
+        }
+        QueueCV.notify_all();
+        for(std::thread& T : WorkerThreads) T.join();
+    };
+    try{
+        bool IsEOF = false, IsSaving = false;
+        size_t LineNumber = CheckpointLine;
+        size_t tmpCounter = 0;
+        while(!IsEOF || !InFlight.empty()){
+            if(!IsEOF && !IsSaving && InFlight.size() < MaxInFlight){
+                std::unique_ptr<BatchStruct> Batch;
+                if(FreeBatches.empty()) Batch.reset(new BatchStruct());
+                else{
+                    Batch = std::move(FreeBatches.back());
+                    FreeBatches.pop_back();
                 }
-                tmpHeaderStrings.erase(tmpHeaderStrings.begin(),tmpHeaderStrings.begin()+9);
-                size_t i(0);
-                Log(std::to_string(tmpHeaderStrings.size()) + " samples identified...");
-                for(const std::string& tmpName : tmpHeaderStrings){
-                    bool Remove=false;
-                    if(!RemoveSamples.empty()){
-                        if(RemoveSamples.find(tmpName)!=RemoveSamples.end()){
-                            RemoveIndex.insert(i);
-                            Remove=true;
-                        }
+                Batch->LineCount = 0;
+                Batch->FirstLine = LineNumber+1;
+                Batch->IsDone = false;
+                size_t tmpBytes = 0;
+                StageClock Clock;
+                if(IsMetrics) Clock.Reset();
+                while(Batch->LineCount < BatchLines && tmpBytes < BatchBytes){
+                    if(Batch->Lines.size() <= Batch->LineCount){
+                        Batch->Lines.emplace_back();
+                        Batch->Records.emplace_back();
                     }
-                    if(!KeepSamples.empty()){
-                        if(KeepSamples.find(tmpName)==KeepSamples.end()){
-                            RemoveIndex.insert(i);
-                            Remove=true;
-                        }
+                    boost::string_view& tmpRecord = Batch->Records[Batch->LineCount];
+                    if(!GetRecord(tmpRecord, Batch->Lines[Batch->LineCount])){
+                        IsEOF = true;
+                        break;
                     }
-                    if(!Remove){
-                        HeaderSamples.push_back(tmpName);
-                        SampleStatsStruct tmpSTATS;
-                        tmpSTATS.Depth.resize(YLim+1,0);
-                        tmpSTATS.Quality.resize(YLim+1,0);
-                        SampleStatsVector.push_back(std::move(tmpSTATS));
+                    tmpBytes += tmpRecord.size();
+                    Batch->LineCount++;
+                }
+                LineNumber += Batch->LineCount;
+                if(IsMetrics){
+                    Clock.Lap(Status.StageWall[STAGE_READ], Status.StageCpu[STAGE_READ]);
+                    Status.InputBytes += tmpBytes + Batch->LineCount;
+                }
+                if(Batch->LineCount){
+                    {
+                        std::lock_guard<std::mutex> Lock(QueueMutex);
+                        WorkQueue.push_back(Batch.get());
                     }
-                    i++;
+                    QueueCV.notify_one();
+                    InFlight.push_back(std::move(Batch));
+                }
+                else FreeBatches.push_back(std::move(Batch));
+            }
+            while(!InFlight.empty()){
+                BatchStruct& Front = *InFlight.front();
+                {
+                    std::unique_lock<std::mutex> Lock(QueueMutex);
+                    if(!Front.IsDone && !IsEOF && !IsSaving && InFlight.size() < MaxInFlight) break;
+                    DoneCV.wait(Lock, [&]{return Front.IsDone;});
+                    if(WorkerError) std::rethrow_exception(WorkerError);
+                }
+                StageClock Clock;
+                if(IsMetrics) Clock.Reset();
+                WriteOutput(Front.Output);
+                if(IsMetrics){
+                    Clock.Lap(Status.StageWall[STAGE_WRITE], Status.StageCpu[STAGE_WRITE]);
+                    Status.OutputBytes += Front.Output.size();
+                }
+                tmpCounter += Front.LineCount;
+                FlushStatus(Front.Status, Status);
+                FreeBatches.push_back(std::move(InFlight.front()));
+                InFlight.pop_front();
+                bool IsDue = IsMetricsDue();
+                if(tmpCounter >= Verbosity || IsDue){
+                    tmpCounter = 0;
+                    ShowProgress();
+                    if(IsDue) EmitMetrics("running");
                 }
-                if(RemoveSamples.size()>0 || KeepSamples.size()>0)
-                    Log(std::to_string(HeaderSamples.size()) + " samples remaining after '--remove|--keep' applied...");
-                break;
             }
-            CommentLines.push_back(temp_string);
+            /*************
+                A checkpoint stops reading until the batches in flight
+                are written, then the output, counters and worker
+                statistics all end at the same line
+            *************/
+            if(IsSaving && InFlight.empty()){
+                SaveCheckpoint(LineNumber);
+                IsSaving = false;
+            }
+            else if(IsCheckpointDue()) IsSaving = true;
         }
-        else Terminate("VCF header without '#' starting character.");
     }
-    if(!HeaderSamples.size()) Terminate("No samples in VCF file.");
-    OutputHeader();
-}
-void LCVCFtools::ReadData(){
-    size_t tmpCounter = 0;
-    while(true){
-        std::string tmpLineString;
-        if(!GetLine(tmpLineString)) break;
-        if(tmpLineString[0]=='#') Terminate("Invalid line at "+std::to_string(InputCounter)+".");
-        tmpSnpData=SnpDataStruct();
-        InputCounter++;
-        if(!StringToVcf(tmpLineString)) Terminate("Failed to read data at line " + std::to_string(InputCounter)+", check the file format");
-        if(Filter()){
-            OutputCounter++;
-            OutputLine();
-        }
-        if(++tmpCounter >= Verbosity){
-            tmpCounter = 0;
-            ShowProgress();
-        }
+    catch(...){
+        StopWorkers();
+        throw;
     }
+    StopWorkers();
+    MergeSampleStatistics();
 }
 void LCVCFtools::ShowProgress(){
-    if(InputCounter==0 || !IsVerbose) return;
+    if(Status.InputCounter==0 || !IsVerbose) return;
     std::clog << '\r' << NowString();
     if(IsFile)
-        std::clog << "Progress=" << std::to_string(static_cast<int>(float(file.tellg()*100/float(filesize)))) << "%;";
-    std::clog << "Input=" << InputCounter << ";";
-    std::clog << "Output=" << OutputCounter << "(" << (static_cast<double>(OutputCounter)/InputCounter)*100 << "%);";
+        std::clog << "Progress=" << std::to_string(static_cast<int>(float(InputOffset()*100/float(filesize)))) << "%;";
+    std::clog << "Input=" << Status.InputCounter << ";";
+    std::clog << "Output=" << Status.OutputCounter << "(" << (static_cast<double>(Status.OutputCounter)/Status.InputCounter)*100 << "%);";
     std::clog << "Filtered:{";
     if(minGCR>0)
-        std::clog << "GCR=" << (static_cast<double>(RemovedGenotypeCallRate)/InputCounter)*100 << "%;";
+        std::clog << "GCR=" << (static_cast<double>(Status.RemovedGenotypeCallRate)/Status.InputCounter)*100 << "%;";
     if(MAF>0)
-        std::clog << "MAF=" << (static_cast<double>(RemovedMAF)/InputCounter)*100 << "%;";
+        std::clog << "MAF=" << (static_cast<double>(Status.RemovedMAF)/Status.InputCounter)*100 << "%;";
     if(IsRemoveMultiallelic)
-        std::clog << "MAL=" << (static_cast<double>(RemovedMultiallelic)/InputCounter)*100 << "%;";
-    for(size_t i(0);i < RemovedDepthRate.size(); i++)
+        std::clog << "MAL=" << (static_cast<double>(Status.RemovedMultiallelic)/Status.InputCounter)*100 << "%;";
+    for(size_t i(0);i < Status.RemovedDepthRate.size(); i++)
         std::clog << "DPR[" << DPRlevel[i] << "," << DPRvalue[i] << "]="
-                  << (static_cast<double>(RemovedDepthRate[i])/InputCounter)*100
+                  << (static_cast<double>(Status.RemovedDepthRate[i])/Status.InputCounter)*100
                   << "%;";
-    for(size_t i(0);i < RemovedQualityRate.size(); i++)
+    for(size_t i(0);i < Status.RemovedQualityRate.size(); i++)
         std::clog << "GQR[" << GQRlevel[i] << "," << GQRvalue[i] << "]="
-                  << (static_cast<double>(RemovedQualityRate[i])/InputCounter)*100
+                  << (static_cast<double>(Status.RemovedQualityRate[i])/Status.InputCounter)*100
                   << "%;";
     std::clog << "}" << std::flush;
 }
-void LCVCFtools::OutputSampleStatistics(){
-    if(!IsSampleStats) return;
-    Log("Calculating sample statistics...");
-    for(size_t i(0); i < HeaderSamples.size(); i++) SampleStatsVector[i].SampleId = HeaderSamples[i];
-    std::sort(SampleStatsVector.begin(),SampleStatsVector.end(),[](const SampleStatsStruct& a, const SampleStatsStruct& b)->bool{return a.NonMissingRate > b.NonMissingRate;});
-    SampleStatsFile << "## NMR=Mean non-missing rate" << std::endl;
-    SampleStatsFile << "## MDP=Mean Depth" << std::endl;
-    SampleStatsFile << "## MGQ=Mean Quality" << std::endl;
-    SampleStatsFile << "## DP=Depth at a given level" << std::endl;
-    SampleStatsFile << "## GQ=Genotype at a given level" << std::endl;
-    SampleStatsFile << "Sample\tVariable\tLevel\tValue" << std::endl;
-    for(SampleStatsStruct& x : SampleStatsVector){
-        int tmpDPsum = std::accumulate(x.Depth.begin()+1,x.Depth.end(),0);
-        int tmpGQsum = std::accumulate(x.Quality.begin()+1,x.Quality.end(),0);
-        x.MeanDepth=0;
-        x.MeanQuality=0;
-        for(int i(1); i < YLim+1; i++) x.MeanDepth+=static_cast<double>(x.Depth[i]*i)/tmpDPsum;
-        for(int i(1); i < YLim+1; i++) x.MeanQuality+=static_cast<double>(x.Quality[i]*i)/tmpGQsum;
-        for(int i(1); i < YLim+1; i++){
-            for(int j(i+1); j < YLim+1; j++){
-                x.Depth[i] += x.Depth[j];
-                x.Quality[i] += x.Quality[j];
-            }
-        }
-        SampleStatsFile << x.SampleId << "\t" << "NMR" << "\t.\t" << x.NonMissingRate/OutputCounter << std::endl;
-        SampleStatsFile << x.SampleId << "\t" << "MDP" << "\t.\t" << x.MeanDepth << std::endl;
-        SampleStatsFile << x.SampleId << "\t" << "MGQ" << "\t.\t" << x.MeanQuality << std::endl;
-        for(int i(1); i < YLim+1; i++){
-            double tmpValue = static_cast<double>(x.Depth[i])/tmpDPsum;
-            if(tmpValue < YLimThreshold) break;
-            SampleStatsFile << x.SampleId << "\t" << "DP" << "\t" << i << "\t" << tmpValue << std::endl;
-        }
-        for(int i(1); i < YLim+1; i++){
-            double tmpValue = static_cast<double>(x.Quality[i])/tmpGQsum;
-            if(tmpValue < YLimThreshold) break;
-            SampleStatsFile << x.SampleId << "\t" << "GQ" << "\t" << i << "\t" << tmpValue << std::endl;
-        }
-    }
-}
-void LCVCFtools::OutputHeader(){
-    for(const auto& tmpString : CommentLines) std::cout << tmpString << '\n';
-    std::cout << "##LCVCFtools_v"
-              << THIS_VERSION
-              << " "
-              << GetParametersString()
-              << "Date="
-              << StartingTimeStr
-              << '\n';
-    std::string tmpHeaderString;
-    for(const auto& tmpString : HeaderColumns) tmpHeaderString += tmpString + '\t';
-    for(const auto& tmpString : HeaderSamples) tmpHeaderString += tmpString + '\t';
-    std::cout << tmpHeaderString.erase(tmpHeaderString.size()-1) << '\n';
+bool LCVCFtools::IsMetricsDue(){
+    return IsMetrics && std::chrono::steady_clock::now() >= NextMetrics;
 }
-void LCVCFtools::OutputLine(){
-    std::string tmpString =
-                 tmpSnpData.CHR    + '\t' +
-                 tmpSnpData.POS    + '\t' +
-                 tmpSnpData.ID     + '\t' +
-                 tmpSnpData.REF    + '\t' +
-                 tmpSnpData.ALT    + '\t' +
-                 tmpSnpData.QUAL   + '\t' +
-                 tmpSnpData.FILTER + '\t' +
-                 tmpSnpData.INFO   + '\t';
-    bool tmpBl = true;
-    for(const auto& TAG : FORMATtagsVector){
-        if(tmpBl) tmpBl = false;
-        else tmpString += ':';
-        tmpString += TAG;
-    }
-    for(const auto& SAMPLE : tmpSnpData.SampleDataVector){
-        tmpBl = true;
-        tmpString += '\t';
-        for(const auto& FORMAT : SAMPLE.FORMAT){
-            if(tmpBl) tmpBl = false;
-            else tmpString += ':';
-            tmpString += FORMAT;
-        }
-    }
-    std::cout << tmpString << '\n';
-}
-bool LCVCFtools::CheckRate(const std::vector<int> &vec, int val, double qnt){
-    double tmp(0);
-    for(const auto& i : vec) if(i>=val) tmp++;
-    tmp /= vec.size();
-    return(tmp<qnt);
-}
-bool LCVCFtools::Filter(){
-    if(IsRemoveMultiallelic && tmpSnpData.AlleleCountVector.size()>2) {
-        RemovedMultiallelic++;
-        return false;
-    }
-    std::vector<int> tmpGQ, tmpDP;
-    tmpGQ.reserve(tmpSnpData.SampleDataVector.size());
-    tmpDP.reserve(tmpSnpData.SampleDataVector.size());
-    for(SampleDataStruct& Sample : tmpSnpData.SampleDataVector){
-        int DP = StringToInt(*Sample.DP);
-        int GQ = StringToInt(*Sample.GQ);
-        tmpDP.push_back(DP);
-        tmpGQ.push_back(GQ);
-        if(DP==0){
-            *Sample.GT = "./.";
-            *Sample.GQ = "0";
-            tmpGQ[tmpGQ.size()-1]=0;
-            int PLsep(0), ADsep(0);
-            for(const char& c : *Sample.PL) if(c==',') PLsep++;
-            *Sample.PL = '0';
-            while(PLsep--) *Sample.PL += ",0";
-            for(const char& c : *Sample.AD) if(c==',') ADsep++;
-            *Sample.AD = '0';
-            while(ADsep--) *Sample.AD += ",0";
-            continue;
-        }
-        else{
-            /******* Apply minDP FILTER *******/
-            if(DP<minDP) *Sample.GT = "./.";
-            /******* Apply minGQ FILTER *******/
-            if(GQ<minGQ) *Sample.GT = "./.";
-            if(DP>=minDP && GQ>=minGQ) tmpSnpData.GCR++;
-            std::vector<int> AD;
-            int tmpADsum(0);
-            std::vector<std::string> tmpADStrings;
-            boost::split(tmpADStrings,*Sample.AD,boost::algorithm::is_any_of(","));
-            for(std::string ADstr : tmpADStrings) {
-                AD.push_back(StringToInt(ADstr));
-                tmpADsum += AD[AD.size()-1];
-            }
-            if(AD.size()!=tmpSnpData.AlleleCountVector.size())
-                Terminate("Fatal error at AD.size()!=AlleleCount.size()");
-            if(tmpADsum>0)
-                for(size_t i(0); i<AD.size(); i++)
-                    tmpSnpData.AlleleCountVector[i].second += static_cast<double>(AD[i])/tmpADsum;
-        }
-    }// for Sample END_HERE
-    tmpSnpData.GCR /= tmpSnpData.SampleDataVector.size();
-    /******* Apply minGCR FILTER *******/
-    if(tmpSnpData.GCR < minGCR){
-        RemovedGenotypeCallRate++;
-        return false;
-    }
-    /******* Apply minDPR FILTER *******/
-    for(size_t i(0); i < DPRlevel.size();i++){
-        if(CheckRate(tmpDP,DPRlevel[i],DPRvalue[i])){
-            RemovedDepthRate[i]++;
-            return false;
-        }
-    }
-    /******* Apply minGQR FILTER *******/
-    for(size_t i(0); i < GQRlevel.size();i++){
-        if(CheckRate(tmpGQ,GQRlevel[i],GQRvalue[i])){
-            RemovedQualityRate[i]++;
-            return false;
-        }
-    }
-    /******* Apply MAF FILTER *******/
-    if(MAF>0){
-        double AlleleSum(0);
-        for(const auto& A : tmpSnpData.AlleleCountVector) AlleleSum += A.second;
-        if(AlleleSum==0){
-            RemovedMAF++;
-            return false;
-        }
-        for(auto& A : tmpSnpData.AlleleCountVector) A.second /= AlleleSum;
-        std::sort(tmpSnpData.AlleleCountVector.begin(),tmpSnpData.AlleleCountVector.end(),
-                  [](const std::pair<short,double>& a, const std::pair<short,double>& b)->bool{return a.second > b.second;});
-        if((1-tmpSnpData.AlleleCountVector[0].second)<MAF){
-            RemovedMAF++;
-            return false;
-        }
-    }
-    /******* Apply ID *******/
-    if(IsID){
-        tmpSnpData.ID = tmpSnpData.CHR + ":" + tmpSnpData.POS + ':' + tmpSnpData.REF + ':' + tmpSnpData.ALT;
-    }
-    /******* Update Sample Stats *******/
-    if(IsSampleStats){
-        for(size_t i(0); i<SampleStatsVector.size(); i++){
-            if(tmpDP[i]>YLim) tmpDP[i] = YLim;
-            if(tmpGQ[i]>YLim) tmpGQ[i] = YLim;
-            SampleStatsVector[i].Depth[tmpDP[i]]++;
-            SampleStatsVector[i].Quality[tmpGQ[i]]++;
-            SampleStatsVector[i].NonMissingRate += (tmpDP[i]>0)?1:0;
-        }
-    }
-    return true;
+void LCVCFtools::Run(RecordCallback tmpOnRecord, HeaderCallback tmpOnHeader){
+    OnRecord = tmpOnRecord;
+    OnHeader = tmpOnHeader;
+    Run();
 }
 void LCVCFtools::Run(){
     if(IsVerbose) std::clog << std::fixed << std::setprecision(1);
     StartingTimeStr = NowString();
+    StartTime = std::chrono::steady_clock::now();
+    NextMetrics = StartTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(MetricsInterval));
+    NextCheckpoint = StartTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(CheckpointInterval));
+    if(IsMetrics) AllocationCounter::Enable();
+#ifdef LCVCF_CHECK_ALLOCATIONS
+    AllocationCounter::Enable();
+#endif
     Log("Running LCVCFtools v" + std::string(THIS_VERSION));
     Log("Running with parameters: " + GetParametersString());
     Log("Starting...");
-    ReadHeader();
-    ReadData();
-    ShowProgress();
-    OutputSampleStatistics();
+    try{
+        ReadHeader();
+        if(!ListFiles.empty()) ReadList();
+        else{
+            OpenRegions();
+            InitWorkers();
+            if(IsResumed) ResumeCheckpoint();
+            if(IsBuildCache) BuildCache();
+            else ReadData();
+        }
+        StageClock Clock;
+        if(IsMetrics) Clock.Reset();
+        if(IsSweep) OutputSweep();
+        else if(!IsBuildCache) CloseOutputStream();
+        if(IsMetrics) Clock.Lap(Status.StageWall[STAGE_WRITE], Status.StageCpu[STAGE_WRITE]);
+        ShowProgress();
+#ifdef LCVCF_CHECK_ALLOCATIONS
+        size_t AllocatingSites = 0, FirstAllocatingLine = 0;
+        for(const WorkerStruct& W : Workers){
+            if(!W.AllocatingSites) continue;
+            if(!AllocatingSites || W.FirstAllocatingLine < FirstAllocatingLine) FirstAllocatingLine = W.FirstAllocatingLine;
+            AllocatingSites += W.AllocatingSites;
+        }
+        if(AllocatingSites) Warn(std::to_string(AllocatingSites) + " site(s) allocated on the heap after warm-up, the first at line " +
+                                 std::to_string(FirstAllocatingLine));
+#endif
+        OutputSampleStatistics();
+        if(!CheckpointFilename.empty()) std::remove(CheckpointFilename.c_str());
+    }
+    catch(...){
+        EmitMetrics("failed");
+        throw;
+    }
+    EmitMetrics("finished");
     if(IsVerbose) std::clog << std::endl;
     Log("Finished.");
 }
+void LCVCFtools::StartStages(){
+    ReadHeader();
+    InitWorkers();
+}
+bool LCVCFtools::ReadStageLine(std::string& Line){
+    return GetLine(Line);
+}
+bool LCVCFtools::ParseStage(boost::string_view Record){
+    WorkerStruct& W = Workers[0];
+    W.SnpData.Reset();
+    return StringToVcf(W, Record);
+}
+bool LCVCFtools::FilterStage(){
+    return Filter(Workers[0]);
+}
+void LCVCFtools::OutputStage(){
+    WorkerStruct& W = Workers[0];
+    OutputLine(W);
+    W.Output.clear();
+}
+bool LCVCFtools::RateStage(const std::vector<int>& Values, int Level, double Rate){
+    return CheckRate(Values, Level, Rate);
+}
@@ -12,6 +12,15 @@
 #include <ctime>
 #include <cmath>
 #include <numeric>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <exception>
+#include <cstring>
+#include <cstdlib>
 /************************************************************
 Copyright Joe Coder 2004 - 2006.
 Distributed under the Boost Software License, Version 1.0.
@@ -22,51 +31,233 @@ https://www.boost.org/LICENSE_1_0.txt)
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/utility/string_view.hpp>
+#include <boost/functional/hash.hpp>
+#include "bgzf.h"
+#include "bcf.h"
+#include "cache.h"
+#include "config.h"
+#include "index.h"
+#include "kernels.h"
+#include "linereader.h"
+#include "metrics.h"
+#include "scan.h"
+#include "stats.h"
 #define THIS_VERSION "1.0.4"
+/*************
+    Filter engine behind the command line and LCVCFfilter, this header
+    is not installed with the library
+*************/
 class LCVCFtools
 {
 public:
     LCVCFtools(int argc, char* argv[]);
+    explicit LCVCFtools(const FilterConfig& Config);
     LCVCFtools();
     void Run();
+    void Run(RecordCallback tmpOnRecord, HeaderCallback tmpOnHeader = HeaderCallback());
+    const std::vector<std::string>& Samples() const;
+    size_t InputRecords() const;
+    size_t OutputRecords() const;
+    /*************
+        Stage API, single records go through the first worker one
+        stage at a time so each stage can be timed
+    *************/
+    void StartStages();
+    bool ReadStageLine(std::string& Line);
+    bool ParseStage(boost::string_view Record);
+    bool FilterStage();
+    void OutputStage();
+    bool RateStage(const std::vector<int>& Values, int Level, double Rate);
 private:
-    struct SampleStatsStruct{
-        std::vector<int> Depth, Quality;
-        double NonMissingRate, MeanDepth, MeanQuality;
-        std::string SampleId;
-    };
     struct SampleDataStruct{
-        std::vector<std::string> FORMAT;
-        std::string *GT, *PL, *DP, *AD, *GQ;
+        boost::string_view Text, DP, GQ, AD;
+        size_t Column = 0;
+        bool IsMissingGT = false;
+        bool IsZeroed = false;
     };
     struct SnpDataStruct{
-        std::string CHR, POS, ID, REF, ALT, QUAL, FILTER, INFO, FORMATstr;
+        boost::string_view CHR, POS, ID, REF, ALT, QUAL, FILTER, INFO, FORMATstr;
+        std::string SiteBuffer;
+        std::vector<BcfDecoder::TypedStruct> BcfFORMAT;
+        bool IsBcf = false;
         std::vector<SampleDataStruct> SampleDataVector;
-        std::vector<std::pair<int,double>> AlleleCountVector;
+        std::vector<double> AlleleCountVector;
         double GCR=0;
+        void Reset(){
+            /*************
+                Buffers are cleared but keep their capacity, so the
+                same record is reused for every site of a worker
+            *************/
+            CHR = POS = ID = REF = ALT = QUAL = FILTER = INFO = FORMATstr = boost::string_view();
+            SiteBuffer.clear();
+            BcfFORMAT.clear();
+            IsBcf = false;
+            SampleDataVector.clear();
+            AlleleCountVector.clear();
+            GCR = 0;
+        }
+    };
+    enum StageEnum {STAGE_READ, STAGE_DECOMPRESS, STAGE_TOKENIZE, STAGE_FILTER, STAGE_SERIALIZE, STAGE_WRITE, STAGE_COUNT};
+    struct StatusStruct{
+        size_t InputCounter = 0;
+        size_t OutputCounter = 0;
+        size_t RemovedGenotypeCallRate = 0;
+        size_t RemovedMultiallelic = 0;
+        size_t RemovedIndels = 0;
+        size_t RemovedMAF = 0;
+        std::vector<size_t> RemovedDepthRate;
+        std::vector<size_t> RemovedQualityRate;
+        size_t InputBytes = 0, OutputBytes = 0;
+        double StageWall[STAGE_COUNT] = {}, StageCpu[STAGE_COUNT] = {};
+    };
+    struct FormatLayoutStruct{
+        size_t Hash = 0;
+        std::string FORMATstr;
+        std::vector<std::string> Tags;
+        size_t GTslot = 0, PLslot = 0, DPslot = 0, ADslot = 0, GQslot = 0;
+    };
+    struct SweepStruct{
+        int minDP = 5, minGQ = 20;
+        double minGCR = 0, MAF = 0.1;
+        std::vector<int> DPRlevel, GQRlevel;
+        std::vector<double> DPRvalue, GQRvalue;
+    };
+    struct WorkerStruct{
+        SnpDataStruct SnpData;
+        std::deque<FormatLayoutStruct> FormatLayouts;
+        const FormatLayoutStruct* Layout = nullptr;
+        std::vector<int> DPvalues, GQvalues, ADvalues, ADcolumns, ADsums;
+        std::vector<size_t> FilterOrder, FilterCounts, FilterRejections;
+        size_t FilterSites = 0;
+        size_t ProcessedSites = 0, CacheMisses = 0, AllocatingSites = 0, FirstAllocatingLine = 0;
+        std::vector<StatusStruct> SweepStatus;
+        std::map<size_t,std::string> ZeroListCache;
+        StatusStruct Status;
+        SampleStatistics SampleStats;
+        std::string Output;
+    };
+    struct ListFileStruct{
+        std::string Filename, OutputFilename;
+        FilterConfig::FormatEnum Format = FilterConfig::FORMAT_VCF;
+        uint64_t Size = 0;
+        bool IsDone = false;
+    };
+    /*************
+        With --split-samples one record is split in a chunk per
+        thread, Begin and End delimit whole sample columns
+    *************/
+    enum ChunkPhaseEnum {CHUNK_COLUMNS, CHUNK_TOKENS, CHUNK_SAMPLES, CHUNK_ALLELES, CHUNK_OUTPUT};
+    struct SampleChunkStruct{
+        const char *Begin = nullptr, *End = nullptr;
+        size_t FirstColumn = 0, Columns = 0;
+        size_t FirstSample = 0, LastSample = 0;
+        std::vector<size_t> FilterCounts;
+        bool IsValid = true;
+    };
+    struct BatchStruct{
+        std::vector<std::string> Lines;
+        std::vector<boost::string_view> Records;
+        size_t LineCount = 0;
+        size_t FirstLine = 0;
+        std::string Output;
+        StatusStruct Status;
+        bool IsDone = false;
     };
     /*************
         FUNCTIONS
     *************/
     void CheckARG(std::string Argument, bool IsUnique = true);
     void Log(std::string Msg);
+    void Warn(std::string Msg);
     void OutputHeader();
-    void OutputLine();
+    void OpenOutputStream();
+    void OpenIndex();
+    void CloseOutputStream();
+    void WriteOutput(const std::string& Data, bool IsRecords = true);
+    void SendRecords(const std::string& Data);
+    void OutputLine(WorkerStruct& W);
+    void OutputSample(WorkerStruct& W, const SampleDataStruct& Sample);
     void ReadData();
+    void ReadRecords();
+    void ReadListFile(std::string Filename);
+    void ReadList();
+    void RunListFile(size_t Index, size_t tmpThreads);
+    void CopyListOutput(size_t Index);
+    bool IsSameHeader(const LCVCFtools& Other);
+    void ReadDataThreaded();
+    void WorkerThread(WorkerStruct& W);
+    void StartChunks();
+    void StopChunks();
+    void ChunkThread(size_t Index);
+    void RunChunks(ChunkPhaseEnum Phase);
+    void ProcessChunk(size_t Index);
+    bool SplitColumns(WorkerStruct& W, boost::string_view Columns);
+    void InitWorkers();
+    void FlushStatus(StatusStruct& Source, StatusStruct& Target);
+    void MergeSampleStatistics();
+    void ProcessLine(WorkerStruct& W, boost::string_view tmpLineString, size_t LineNumber);
     void ReadHeader();
+    void ReadBcfHeader();
+    void SetFORMAT(WorkerStruct& W);
     void ReadKeepList(std::string Filename);
     void ReadRemoveList(std::string Filename);
+    void AddRegion(std::string Region);
+    void ReadRegionsFile(std::string Filename);
+    void OpenRegions();
+    bool IsInRegions(boost::string_view Record);
     void OpenInputStream();
-    void SetParameters(std::vector<std::string>& args);
+    void SetParameters(std::vector<std::string>& args, FilterConfig& Config);
+    void ApplyConfig(const FilterConfig& Config);
     void ShowHelp();
     void ShowProgress();
+    bool IsMetricsDue();
+    void EmitMetrics(std::string State);
+    std::string CheckpointSignature();
+    void OpenCheckpoint();
+    void ResumeOutput();
+    void ResumeCheckpoint();
+    bool IsCheckpointDue();
+    void SaveCheckpoint(size_t LineNumber);
     void OutputSampleStatistics();
     void Terminate(std::string Msg);
     bool CheckRate(const std::vector<int> &vec, int val, double qnt);
-    bool Filter();
+    bool Filter(WorkerStruct& W);
+    int RejectingFilter(WorkerStruct& W, size_t Parsed, size_t Total);
+    void DecodeSample(WorkerStruct& W, const SampleDataStruct& Sample, int& DP, int& GQ);
+    void DecodeSamples(WorkerStruct& W, WorkerStruct& Record, size_t Begin, size_t End, size_t* Counts);
+    void ReadAlleles(WorkerStruct& W, WorkerStruct& Record, size_t Begin, size_t End);
+    double MinorAlleleFrequency(WorkerStruct& W);
+    double MinorAlleleShare(WorkerStruct& W);
+    void SweepSite(WorkerStruct& W);
+    void ReadSweepFile(std::string Filename);
+    void OutputSweep();
+    void UpdateFilterOrder(WorkerStruct& W);
     bool GetLine(std::string& TmpString);
-    bool StringToVcf(const std::string& tmpLineString);
-    int StringToInt(const std::string& String);
+    bool GetRecord(boost::string_view& Record, std::string& TmpString);
+    bool GetCachedRecord(boost::string_view& Record, std::string& TmpString);
+    void OpenCache();
+    void BuildCache();
+    bool CacheFilter(WorkerStruct& W, const GenotypeCache::SiteStruct& Site);
+    bool GetHeaderLine(std::string& TmpString);
+    bool GetBcfRecord(std::string& TmpString);
+    size_t ReadBytes(char* Buffer, size_t Size);
+    std::istream& InputStream();
+    size_t InputOffset();
+    bool BcfToVcf(WorkerStruct& W, boost::string_view tmpRecord);
+    bool StringToVcf(WorkerStruct& W, boost::string_view tmpLineString);
+    bool SplitSamples(const FormatLayoutStruct& Layout, const char* p, const char* end, size_t Column,
+                      size_t First, size_t Last, SampleDataStruct* Samples);
+    bool SetAlleles(WorkerStruct& W);
+    int StringToInt(boost::string_view String);
+    int ParseInt(const char* Begin, const char* End);
+    void ParseInts(const char* Begin, const char* End, std::vector<int>& Values);
+    int SampleInt(WorkerStruct& W, const SampleDataStruct& Sample, size_t Slot);
+    void SampleInts(WorkerStruct& W, const SampleDataStruct& Sample, size_t Slot, std::vector<int>& Values);
+    size_t SampleSeparators(WorkerStruct& W, const SampleDataStruct& Sample, size_t Slot);
+    boost::string_view ZeroList(WorkerStruct& W, size_t Separators);
     std::string GetParametersString();
     std::string NowString();
     /*************
@@ -80,9 +271,25 @@ private:
     std::ifstream file;
     size_t filesize;
     boost::iostreams::filtering_istream in;
+    std::unique_ptr<BgzfReader> Bgzf;
+    std::unique_ptr<MappedReader> Mapped;
+    std::unique_ptr<BufferedReader> Buffered;
     std::string InputFilename;
     bool IsGzipped = false;
+    bool IsBcf = false;
     bool IsFile = true;
+    BcfDecoder Bcf;
+    std::deque<std::string> BcfHeaderLines;
+    /*************
+        OUTPUT
+    *************/
+    std::string OutputFilename;
+    std::unique_ptr<BufferedWriter> PlainWriter;
+    std::unique_ptr<BgzfWriter> Writer;
+    std::unique_ptr<TabixIndex> Index;
+    bool IsCsi = false;
+    RecordCallback OnRecord;
+    HeaderCallback OnHeader;
     /*************
         FILTER PARAMETERS
     *************/
@@ -99,37 +306,94 @@ private:
     bool IsID = false;
     bool IsSampleStats = false;
     bool IsRemoveMultiallelic = true;
+    bool IsAdaptiveFilters = false;
+    bool IsSweep = false;
+    std::string SweepFilename;
+    std::vector<SweepStruct> SweepGrid;
     std::set<std::string> RemoveSamples, KeepSamples;
-    std::set<size_t> RemoveIndex;
+    std::vector<size_t> KeepColumns;
+    size_t InputSamples = 0;
+    /*************
+        REGIONS
+    *************/
+    std::map<std::string,std::vector<std::pair<int64_t,int64_t>>> RegionMap;
+    std::vector<TabixIndex::ChunkStruct> RegionChunks;
+    size_t ChunkIndex = 0;
+    bool IsRegions = false;
+    bool IsIndexed = false;
+    /*************
+        CACHE
+    *************/
+    std::string CacheFilename;
+    bool IsBuildCache = false;
+    std::unique_ptr<CacheReader> Cache;
+    WorkerStruct CacheWorker;
+    uint64_t CacheSkipBytes = 1 << 20;
     /*************
         VCF DATA
     *************/
     std::vector<std::string> CommentLines, HeaderColumns, HeaderSamples;
-    std::string lastFORMATstr;
-    std::map<std::string,size_t> FORMATtagsMap;
-    std::vector<std::string> FORMATtagsVector;
     /*************
-        TEMP SNP DATA
+        WORKERS
+    *************/
+    std::string LineBuffer;
+    std::vector<WorkerStruct> Workers;
+    size_t Threads = 1;
+    size_t BatchLines = 1024;
+    size_t BatchBytes = 1 << 22;
+    size_t MaxFormatLayouts = 64;
+    size_t AllocationWarmup = 1024;
+    std::mutex QueueMutex;
+    std::condition_variable QueueCV, DoneCV;
+    std::deque<BatchStruct*> WorkQueue;
+    bool IsQueueClosed = false;
+    std::exception_ptr WorkerError;
+    /*************
+        SAMPLE CHUNKS
     *************/
-    SnpDataStruct tmpSnpData;
+    bool IsSplitSamples = false;
+    std::vector<SampleChunkStruct> SampleChunks;
+    std::vector<std::thread> ChunkThreads;
+    ChunkPhaseEnum ChunkPhase = CHUNK_COLUMNS;
+    size_t ChunkGeneration = 0, ChunksPending = 0;
+    /*************
+        FILE LIST
+    *************/
+    std::vector<ListFileStruct> ListFiles;
+    FilterConfig ListConfig;
+    std::string OutputSuffix;
+    uint64_t ListOffset = 0;
+    LCVCFtools* ListParent = nullptr;
+    std::mutex ListMutex;
+    std::condition_variable ListCV;
     /*************
         STATUS
     *************/
-    size_t InputCounter = 0;
-    size_t OutputCounter = 0;
-    size_t RemovedGenotypeCallRate = 0;
-    size_t RemovedMultiallelic = 0;
-    size_t RemovedIndels = 0;
-    size_t RemovedMAF = 0;
+    StatusStruct Status;
     size_t Verbosity = 10000;
-    std::vector<size_t> RemovedDepthRate;
-    std::vector<size_t> RemovedQualityRate;
+    /*************
+        METRICS
+    *************/
+    bool IsMetrics = false;
+    std::string MetricsFilename;
+    double MetricsInterval = 10;
+    std::chrono::steady_clock::time_point StartTime, NextMetrics;
+    /*************
+        CHECKPOINT
+    *************/
+    std::string CheckpointFilename;
+    double CheckpointInterval = 60;
+    bool IsResume = false, IsResumed = false;
+    std::string CheckpointData;
+    size_t CheckpointPos = 0, CheckpointLine = 0;
+    std::chrono::steady_clock::time_point NextCheckpoint;
     /*************
         STATS
     *************/
     std::ofstream SampleStatsFile;
-    std::vector<SampleStatsStruct> SampleStatsVector;
+    SampleStatistics SampleStats;
     int YLim = 100;
+    bool IsStatsSketch = false;
     double YLimThreshold = 0.001;
 };
 #endif
@@ -0,0 +1,211 @@
+#include "linereader.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+MappedReader::MappedReader(const std::string& Filename){
+    fd = open(Filename.c_str(), O_RDONLY);
+    if(fd < 0) throw std::runtime_error("Can't open " + Filename);
+    struct stat Info;
+    if(fstat(fd, &Info)!=0 || !S_ISREG(Info.st_mode)){
+        close(fd);
+        throw std::runtime_error("Can't map " + Filename);
+    }
+    Length = Info.st_size;
+    if(Length){
+        void* Map = mmap(nullptr, Length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(Map==MAP_FAILED){
+            close(fd);
+            throw std::runtime_error("Can't map " + Filename);
+        }
+        Data = static_cast<const char*>(Map);
+        madvise(Map, Length, MADV_SEQUENTIAL);
+        Advise();
+    }
+}
+MappedReader::~MappedReader(){
+    if(Data) munmap(const_cast<char*>(Data), Length);
+    if(fd >= 0) close(fd);
+}
+void MappedReader::Advise(){
+    /*************
+        MADV_WILLNEED starts asynchronous read-ahead of the next window,
+        so page faults are mostly served from the page cache
+    *************/
+    if(AdvisedPos >= Length || Pos + ReadAhead/2 < AdvisedPos) return;
+    const size_t PageSize = sysconf(_SC_PAGESIZE);
+    size_t Begin = AdvisedPos / PageSize * PageSize;
+    size_t End = std::min(Length, Pos + ReadAhead);
+    madvise(const_cast<char*>(Data) + Begin, End - Begin, MADV_WILLNEED);
+    AdvisedPos = End;
+}
+bool MappedReader::GetLine(boost::string_view& Line){
+    if(Pos >= Length) return false;
+    const char* Begin = Data + Pos;
+    const char* End = static_cast<const char*>(std::memchr(Begin, '\n', Length - Pos));
+    if(!End) End = Data + Length;
+    Line = boost::string_view(Begin, End - Begin);
+    Pos = std::min(Length, size_t(End - Data) + 1);
+    Advise();
+    return true;
+}
+bool MappedReader::GetLine(std::string& Line){
+    boost::string_view tmpLine;
+    if(!GetLine(tmpLine)) return false;
+    Line.assign(tmpLine.data(), tmpLine.size());
+    return true;
+}
+size_t MappedReader::Tell(){
+    return Pos;
+}
+void MappedReader::Seek(size_t Offset){
+    Pos = std::min(Offset, Length);
+    if(Pos > AdvisedPos) AdvisedPos = Pos;
+    Advise();
+}
+size_t MappedReader::Size(){
+    return Length;
+}
+BufferedReader::BufferedReader(int fd, size_t BufferSize) : fd(fd){
+    for(BufferStruct& Buffer : Buffers) Buffer.Data.resize(BufferSize);
+    if(pipe(StopPipe)!=0) throw std::runtime_error(std::string("Can't create pipe: ") + std::strerror(errno));
+    Reader = std::thread(&BufferedReader::ReaderThread, this);
+}
+BufferedReader::~BufferedReader(){
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        IsClosed = true;
+    }
+    CV.notify_all();
+    /******* Wakes a read blocked on input that hasn't ended *******/
+    while(write(StopPipe[1], "", 1) < 0 && errno==EINTR);
+    Reader.join();
+    close(StopPipe[0]);
+    close(StopPipe[1]);
+}
+void BufferedReader::ReaderThread(){
+    for(size_t i = 0; ; i ^= 1){
+        BufferStruct& Buffer = Buffers[i];
+        {
+            std::unique_lock<std::mutex> Lock(Mutex);
+            CV.wait(Lock, [&]{return !Buffer.IsFull || IsClosed;});
+            if(IsClosed) return;
+        }
+        size_t n = 0;
+        std::string Error;
+        while(n < Buffer.Data.size()){
+            /******* A partly filled buffer is handed over when the input stalls *******/
+            struct pollfd Fds[2] = {{fd, POLLIN, 0}, {StopPipe[0], POLLIN, 0}};
+            int Ready = poll(Fds, 2, n ? 0 : -1);
+            if(Ready < 0 && errno==EINTR) continue;
+            if(Ready < 0) Error = std::string("Can't read input: ") + std::strerror(errno);
+            if(Ready <= 0) break;
+            if(Fds[1].revents) return;
+            ssize_t r = read(fd, Buffer.Data.data() + n, Buffer.Data.size() - n);
+            if(r < 0 && errno==EINTR) continue;
+            if(r < 0) Error = std::string("Can't read input: ") + std::strerror(errno);
+            if(r <= 0) break;
+            n += r;
+        }
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            Buffer.Size = n;
+            Buffer.Error = Error;
+            Buffer.IsFull = true;
+        }
+        CV.notify_all();
+        if(n==0) return;
+    }
+}
+bool BufferedReader::NextBuffer(){
+    if(IsEOF) return false;
+    std::unique_lock<std::mutex> Lock(Mutex);
+    if(Current){
+        Offset += Current->Size;
+        Current->IsFull = false;
+        CV.notify_all();
+    }
+    Index ^= 1;
+    Current = &Buffers[Index];
+    CV.wait(Lock, [&]{return Current->IsFull;});
+    if(!Current->Error.empty()) throw std::runtime_error(Current->Error);
+    Pos = 0;
+    IsEOF = (Current->Size==0);
+    return !IsEOF;
+}
+bool BufferedReader::GetLine(std::string& Line){
+    Line.clear();
+    bool HasData = false;
+    while(true){
+        if(!Current || Pos >= Current->Size){
+            if(!NextBuffer()) return HasData;
+            continue;
+        }
+        const char* Begin = Current->Data.data() + Pos;
+        size_t Left = Current->Size - Pos;
+        const char* End = static_cast<const char*>(std::memchr(Begin, '\n', Left));
+        if(End){
+            Line.append(Begin, End-Begin);
+            Pos += End-Begin+1;
+            return true;
+        }
+        Line.append(Begin, Left);
+        Pos += Left;
+        HasData = true;
+    }
+}
+size_t BufferedReader::Tell(){
+    return Offset + Pos;
+}
+BufferedWriter::BufferedWriter(int fd, size_t BufferSize) : fd(fd), IsOwned(false), Buffer(BufferSize){
+}
+BufferedWriter::BufferedWriter(const std::string& Filename, bool IsAppend, size_t BufferSize) : IsOwned(true), Buffer(BufferSize){
+    fd = open(Filename.c_str(), IsAppend ? O_WRONLY | O_APPEND : O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0) throw std::runtime_error("Output file is not writable");
+}
+BufferedWriter::~BufferedWriter(){
+    try{
+        Close();
+    }
+    catch(const std::runtime_error&){}
+}
+void BufferedWriter::Write(const char* Data, size_t Length){
+    if(Size + Length > Buffer.size()){
+        Flush();
+        /*************
+            Blocks larger than the buffer go straight to the fd
+        *************/
+        if(Length >= Buffer.size()){
+            WriteAll(Data, Length);
+            return;
+        }
+    }
+    std::memcpy(Buffer.data() + Size, Data, Length);
+    Size += Length;
+}
+void BufferedWriter::Flush(){
+    if(!Size) return;
+    size_t Length = Size;
+    Size = 0;
+    WriteAll(Buffer.data(), Length);
+}
+void BufferedWriter::WriteAll(const char* Data, size_t Length){
+    while(Length){
+        ssize_t r = write(fd, Data, Length);
+        if(r < 0 && errno==EINTR) continue;
+        if(r < 0) throw std::runtime_error(std::string("Failed to write output: ") + std::strerror(errno));
+        Data += r;
+        Length -= r;
+    }
+}
+void BufferedWriter::Close(){
+    if(fd < 0) return;
+    Flush();
+    if(IsOwned && close(fd)!=0){
+        fd = -1;
+        throw std::runtime_error("Failed to write output file");
+    }
+    fd = -1;
+}
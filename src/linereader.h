@@ -0,0 +1,96 @@
+#ifndef LINEREADER_H
+#define LINEREADER_H
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <boost/utility/string_view.hpp>
+/*************
+    Plain VCF file mapped in memory, lines are returned as views into
+    the mapping and stay valid until the reader is destroyed.
+*************/
+class MappedReader
+{
+public:
+    MappedReader(const std::string& Filename);
+    ~MappedReader();
+    static const size_t ReadAhead = 1 << 24;
+    bool GetLine(boost::string_view& Line);
+    bool GetLine(std::string& Line);
+    size_t Tell();
+    void Seek(size_t Offset);
+    size_t Size();
+private:
+    void Advise();
+    int fd = -1;
+    const char* Data = nullptr;
+    size_t Length = 0, Pos = 0, AdvisedPos = 0;
+};
+/*************
+    Reads a file descriptor (stdin) in large chunks on a background
+    thread, filling one buffer while lines are taken from the other.
+    The thread waits in poll() on the input and a stop pipe, so the
+    reader can be destroyed while the writer keeps a pipe open.
+*************/
+class BufferedReader
+{
+public:
+    BufferedReader(int fd, size_t BufferSize = 1 << 22);
+    ~BufferedReader();
+    bool GetLine(std::string& Line);
+    size_t Tell();
+private:
+    struct BufferStruct{
+        std::vector<char> Data;
+        size_t Size = 0;
+        bool IsFull = false;
+        std::string Error;
+    };
+    /*************
+        FUNCTIONS
+    *************/
+    bool NextBuffer();
+    void ReaderThread();
+    /*************
+        INPUT
+    *************/
+    int fd;
+    int StopPipe[2] = {-1, -1};
+    BufferStruct Buffers[2];
+    std::thread Reader;
+    std::mutex Mutex;
+    std::condition_variable CV;
+    bool IsClosed = false;
+    /*************
+        CURRENT BUFFER
+    *************/
+    BufferStruct* Current = nullptr;
+    size_t Index = 1, Pos = 0, Offset = 0;
+    bool IsEOF = false;
+};
+/*************
+    Output collected in one large buffer and passed to the file
+    descriptor in big write() calls, records bypass iostreams.
+*************/
+class BufferedWriter
+{
+public:
+    BufferedWriter(int fd, size_t BufferSize = 1 << 23);
+    BufferedWriter(const std::string& Filename, bool IsAppend = false, size_t BufferSize = 1 << 23);
+    ~BufferedWriter();
+    void Write(const char* Data, size_t Size);
+    void Flush();
+    void Close();
+private:
+    void WriteAll(const char* Data, size_t Size);
+    int fd;
+    bool IsOwned;
+    std::vector<char> Buffer;
+    size_t Size = 0;
+};
+#endif
@@ -0,0 +1,171 @@
+#include "lcvcftools.h"
+void LCVCFtools::ReadListFile(std::string Filename){
+    std::ifstream File(Filename);
+    if(!File.is_open()) Terminate("VCF list file does not exist or is not readable.");
+    std::string tmpString;
+    std::set<std::string> OutputNames;
+    if(!OutputFilename.empty()) OutputNames.insert(OutputFilename);
+    while(std::getline(File, tmpString)){
+        boost::algorithm::trim(tmpString);
+        if(tmpString.empty() || tmpString[0]=='#') continue;
+        ListFileStruct F;
+        F.Filename = tmpString;
+        std::ifstream Input(F.Filename, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+        if(!Input.is_open()) Terminate("Listed file " + F.Filename + " does not exist or is not readable");
+        F.Size = Input.tellg();
+        /*************
+            Format follows the extension, the output name drops it
+        *************/
+        std::string Stem = F.Filename;
+        for(const char* Extension : {".gz", ".bgz"}){
+            if(boost::algorithm::ends_with(Stem, Extension)){
+                Stem.erase(Stem.size()-std::strlen(Extension));
+                F.Format = FilterConfig::FORMAT_GZVCF;
+            }
+        }
+        if(boost::algorithm::ends_with(Stem, ".bcf")) F.Format = FilterConfig::FORMAT_BCF;
+        if(boost::algorithm::ends_with(Stem, ".vcf") || boost::algorithm::ends_with(Stem, ".bcf")) Stem.erase(Stem.size()-4);
+        if(!OutputSuffix.empty()) F.OutputFilename = Stem + OutputSuffix;
+        else if(!OutputFilename.empty()) F.OutputFilename = OutputFilename + ".part" + std::to_string(ListFiles.size());
+        else{
+            const char* Directory = std::getenv("TMPDIR");
+            F.OutputFilename = std::string(Directory ? Directory : "/tmp") + "/LCVCFtools_" + std::to_string(getpid()) +
+                               "_" + std::to_string(ListFiles.size()) + ".vcf";
+        }
+        if(F.OutputFilename==F.Filename) Terminate("Output of " + F.Filename + " would overwrite it");
+        if(!OutputNames.insert(F.OutputFilename).second) Terminate("Output of " + F.Filename + " would overwrite " + F.OutputFilename + ", written for an earlier listed file");
+        ListFiles.push_back(F);
+    }
+    if(ListFiles.empty()) Terminate("No files in VCF list.");
+    for(const ListFileStruct& F : ListFiles)
+        if(OutputNames.count(F.Filename)) Terminate("Listed file " + F.Filename + " would be overwritten by the output");
+    Log(std::to_string(ListFiles.size()) + " files in VCF list...");
+}
+bool LCVCFtools::IsSameHeader(const LCVCFtools& Other){
+    return Other.HeaderColumns==HeaderColumns && Other.HeaderSamples==HeaderSamples && Other.InputSamples==InputSamples;
+}
+void LCVCFtools::ReadList(){
+    /*************
+        Files start largest first with a share of the cores in
+        proportion to their size, files started when fewer are left
+        than free cores split all of them, so no core idles while a
+        large file finishes. Concatenated output is copied in list
+        order as soon as the next file is done.
+    *************/
+    if(IsSampleStats) SampleStats.Reset(HeaderSamples.size(), YLim, IsStatsSketch);
+    std::vector<size_t> Order(ListFiles.size());
+    std::iota(Order.begin(), Order.end(), 0);
+    std::stable_sort(Order.begin(), Order.end(), [&](size_t a, size_t b){return ListFiles[a].Size > ListFiles[b].Size;});
+    uint64_t TotalSize = 1;
+    for(const ListFileStruct& F : ListFiles) TotalSize += F.Size;
+    filesize = TotalSize;
+    const bool IsConcatenated = OutputSuffix.empty();
+    size_t FreeThreads = Threads, Started = 0, Copied = 0;
+    std::string ListError;
+    std::vector<std::thread> Jobs;
+    auto Job = [&](size_t i, size_t tmpThreads){
+        std::string tmpError;
+        try{
+            RunListFile(i, tmpThreads);
+        }
+        catch(const std::exception& e){
+            tmpError = ListFiles[i].Filename + ": " + e.what();
+        }
+        std::lock_guard<std::mutex> Lock(ListMutex);
+        if(ListError.empty()) ListError = tmpError;
+        ListFiles[i].IsDone = true;
+        ListOffset += ListFiles[i].Size;
+        FreeThreads += tmpThreads;
+        ListCV.notify_all();
+    };
+    auto Cleanup = [&](){
+        for(std::thread& T : Jobs) T.join();
+        if(IsConcatenated) for(const ListFileStruct& F : ListFiles) std::remove(F.OutputFilename.c_str());
+    };
+    try{
+        std::unique_lock<std::mutex> Lock(ListMutex);
+        while(Copied < ListFiles.size() && ListError.empty()){
+            if(Started < Order.size() && FreeThreads > 0){
+                size_t i = Order[Started++];
+                size_t Left = Order.size() - Started + 1;
+                size_t tmpThreads = std::max<uint64_t>(1, std::llround(static_cast<double>(Threads)*ListFiles[i].Size/TotalSize));
+                if(Left <= FreeThreads) tmpThreads = std::max(tmpThreads, FreeThreads/Left);
+                tmpThreads = std::min(tmpThreads, FreeThreads);
+                FreeThreads -= tmpThreads;
+                Jobs.emplace_back(Job, i, tmpThreads);
+                continue;
+            }
+            if(ListFiles[Copied].IsDone){
+                Lock.unlock();
+                if(IsConcatenated) CopyListOutput(Copied);
+                Lock.lock();
+                Copied++;
+                ShowProgress();
+                continue;
+            }
+            if(IsMetrics) ListCV.wait_until(Lock, NextMetrics);
+            else ListCV.wait(Lock);
+            if(IsMetricsDue()) EmitMetrics("running");
+        }
+    }
+    catch(...){
+        Cleanup();
+        throw;
+    }
+    Cleanup();
+    if(!ListError.empty()) Terminate(ListError);
+}
+void LCVCFtools::RunListFile(size_t Index, size_t tmpThreads){
+    /*************
+        Sample and region lists were read once by this instance and
+        are copied, statistics go back through FlushStatus and Merge
+    *************/
+    const ListFileStruct& F = ListFiles[Index];
+    FilterConfig Config = ListConfig;
+    Config.ListFilename.clear();
+    Config.InputFilename = F.Filename;
+    Config.Format = F.Format;
+    Config.OutputFilename = F.OutputFilename;
+    Config.OutputSuffix.clear();
+    Config.KeepFilename.clear();
+    Config.RemoveFilename.clear();
+    Config.Regions.clear();
+    Config.RegionsFilename.clear();
+    Config.SampleStatsFilename.clear();
+    Config.MetricsFilename.clear();
+    Config.IsVerbose = false;
+    Config.Threads = tmpThreads;
+    LCVCFtools Child(Config);
+    Child.KeepSamples = KeepSamples;
+    Child.RemoveSamples = RemoveSamples;
+    Child.RegionMap = RegionMap;
+    Child.IsRegions = IsRegions;
+    Child.IsMetrics = IsMetrics;
+    Child.ListParent = this;
+    Child.Run();
+    std::lock_guard<std::mutex> Lock(ListMutex);
+    FlushStatus(Child.Status, Status);
+    if(IsSampleStats) SampleStats.Merge(Child.SampleStats);
+    Log("Finished " + F.Filename + " with " + std::to_string(tmpThreads) + " thread(s)");
+}
+void LCVCFtools::CopyListOutput(size_t Index){
+    const std::string& Filename = ListFiles[Index].OutputFilename;
+    std::string Buffer;
+    try{
+        MappedReader Part(Filename);
+        boost::string_view Line;
+        while(Part.GetLine(Line)){
+            if(!Line.empty() && Line[0]=='#') continue;
+            Buffer.append(Line.data(), Line.size());
+            Buffer += '\n';
+            if(Buffer.size() < BatchBytes) continue;
+            WriteOutput(Buffer);
+            Buffer.clear();
+        }
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+    WriteOutput(Buffer);
+    std::remove(Filename.c_str());
+}
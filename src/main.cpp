@@ -5,5 +5,10 @@ int main(int argc, char* argv[]){
         a.Run();
     }
     catch(int i){return i;}
+    catch(const LCVCFerror&){return 1;}
+    catch(const std::exception& e){
+        std::clog << "**ERROR** " << e.what() << std::endl;
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,58 @@
+#include "metrics.h"
+#include <atomic>
+#include <cstdlib>
+#include <ctime>
+#include <sys/resource.h>
+StageClock::StageClock() : CpuStart(0){
+}
+void StageClock::Reset(){
+    WallStart = std::chrono::steady_clock::now();
+    CpuStart = ThreadCpu();
+}
+void StageClock::Lap(double& Wall, double& Cpu){
+    std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+    double CpuNow = ThreadCpu();
+    Wall += std::chrono::duration<double>(Now - WallStart).count();
+    Cpu += CpuNow - CpuStart;
+    WallStart = Now;
+    CpuStart = CpuNow;
+}
+double StageClock::ThreadCpu(){
+    timespec Time;
+    if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Time)!=0) return 0;
+    return Time.tv_sec + Time.tv_nsec*1e-9;
+}
+double StageClock::ProcessCpu(){
+    rusage Usage;
+    if(getrusage(RUSAGE_SELF, &Usage)!=0) return 0;
+    return Usage.ru_utime.tv_sec + Usage.ru_utime.tv_usec*1e-6 + Usage.ru_stime.tv_sec + Usage.ru_stime.tv_usec*1e-6;
+}
+long StageClock::PeakRss(){
+    rusage Usage;
+    if(getrusage(RUSAGE_SELF, &Usage)!=0) return 0;
+    return Usage.ru_maxrss;
+}
+static std::atomic<bool> IsCounting(false);
+static std::atomic<uint64_t> AllocationCount(0), AllocationBytes(0);
+static thread_local uint64_t ThreadAllocations = 0;
+void AllocationCounter::Enable(){
+    IsCounting.store(true, std::memory_order_relaxed);
+}
+bool AllocationCounter::IsEnabled(){
+    return IsCounting.load(std::memory_order_relaxed);
+}
+uint64_t AllocationCounter::Count(){
+    return AllocationCount.load(std::memory_order_relaxed);
+}
+uint64_t AllocationCounter::ThreadCount(){
+    return ThreadAllocations;
+}
+uint64_t AllocationCounter::Bytes(){
+    return AllocationBytes.load(std::memory_order_relaxed);
+}
+void AllocationCounter::Add(std::size_t Size){
+    if(!IsCounting.load(std::memory_order_relaxed)) return;
+    AllocationCount.fetch_add(1, std::memory_order_relaxed);
+    AllocationBytes.fetch_add(Size, std::memory_order_relaxed);
+    ThreadAllocations++;
+}
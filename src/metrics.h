@@ -0,0 +1,41 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+/*************
+    Wall and thread CPU clock for per-stage timing. Reset() starts a
+    stage, Lap() adds the time since the last reading to a stage and
+    starts the next one, so consecutive stages share their boundaries.
+    Nothing is read on construction, so an unused clock is free.
+*************/
+class StageClock
+{
+public:
+    StageClock();
+    void Reset();
+    void Lap(double& Wall, double& Cpu);
+    static double ThreadCpu();
+    static double ProcessCpu();
+    static long PeakRss();
+private:
+    std::chrono::steady_clock::time_point WallStart;
+    double CpuStart;
+};
+/*************
+    Counts calls and bytes of the global operator new once enabled,
+    disabled it only costs a branch per allocation. ThreadCount() is
+    the number of calls made by the calling thread. Counts stay 0
+    unless allocation.cpp is linked.
+*************/
+class AllocationCounter
+{
+public:
+    static void Enable();
+    static bool IsEnabled();
+    static uint64_t Count();
+    static uint64_t ThreadCount();
+    static uint64_t Bytes();
+    static void Add(std::size_t Size);
+};
+#endif
@@ -0,0 +1,363 @@
+#include "lcvcftools.h"
+boost::string_view LCVCFtools::ZeroList(WorkerStruct& W, size_t Separators){
+    auto it = W.ZeroListCache.find(Separators);
+    if(it==W.ZeroListCache.end()){
+        W.CacheMisses++;
+        std::string tmpString = "0";
+        for(size_t i(0); i < Separators; i++) tmpString += ",0";
+        it = W.ZeroListCache.emplace(Separators, std::move(tmpString)).first;
+    }
+    return it->second;
+}
+void LCVCFtools::OutputSweep(){
+    std::ofstream File;
+    if(!OutputFilename.empty()){
+        File.open(OutputFilename);
+        if(!File.is_open()) Terminate("Can't write to " + OutputFilename);
+    }
+    std::ostream& Out = OutputFilename.empty() ? std::cout : File;
+    Out << "Combination\tminDP\tminGQ\tminGCR\tMAF\tminDPR\tminGQR\tInput\tOutput\t"
+           "RemovedGCR\tRemovedMAL\tRemovedDPR\tRemovedGQR\tRemovedMAF\n";
+    auto Join = [](const std::vector<size_t>& Values){
+        std::string tmpString;
+        for(size_t i(0); i < Values.size(); i++) tmpString += (i ? ";" : "") + std::to_string(Values[i]);
+        return tmpString.empty() ? std::string(".") : tmpString;
+    };
+    for(size_t c(0); c < SweepGrid.size(); c++){
+        const SweepStruct& P = SweepGrid[c];
+        StatusStruct S;
+        for(WorkerStruct& W : Workers) FlushStatus(W.SweepStatus[c], S);
+        std::ostringstream DPR, GQR;
+        for(size_t i(0); i < P.DPRlevel.size(); i++) DPR << (i ? ";" : "") << P.DPRlevel[i] << ',' << P.DPRvalue[i];
+        for(size_t i(0); i < P.GQRlevel.size(); i++) GQR << (i ? ";" : "") << P.GQRlevel[i] << ',' << P.GQRvalue[i];
+        Out << c+1 << '\t' << P.minDP << '\t' << P.minGQ << '\t' << P.minGCR << '\t' << P.MAF << '\t'
+            << (P.DPRlevel.empty() ? "." : DPR.str()) << '\t' << (P.GQRlevel.empty() ? "." : GQR.str()) << '\t'
+            << Status.InputCounter << '\t' << S.OutputCounter << '\t' << S.RemovedGenotypeCallRate << '\t'
+            << S.RemovedMultiallelic << '\t' << Join(S.RemovedDepthRate) << '\t' << Join(S.RemovedQualityRate) << '\t'
+            << S.RemovedMAF << '\n';
+    }
+    Out.flush();
+}
+void LCVCFtools::EmitMetrics(std::string State){
+    /*************
+        Written to a temporary file and renamed, readers polling
+        the file never see a partial update
+    *************/
+    if(!IsMetrics || MetricsFilename.empty()) return;
+    std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+    NextMetrics = Now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(MetricsInterval));
+    double Elapsed = std::chrono::duration<double>(Now - StartTime).count();
+    double StageWall[STAGE_COUNT], StageCpu[STAGE_COUNT];
+    std::copy(Status.StageWall, Status.StageWall+STAGE_COUNT, StageWall);
+    std::copy(Status.StageCpu, Status.StageCpu+STAGE_COUNT, StageCpu);
+    if(Bgzf) Bgzf->InflateTime(StageWall[STAGE_DECOMPRESS], StageCpu[STAGE_DECOMPRESS]);
+    const char* StageNames[STAGE_COUNT] = {"read", "decompress", "tokenize", "filter", "serialize", "write"};
+    auto Rate = [&](double Value){return Elapsed > 0 ? Value/Elapsed : 0;};
+    std::ostringstream sso;
+    sso << std::setprecision(6);
+    sso << "{\n"
+        << "  \"version\": \"" << THIS_VERSION << "\",\n"
+        << "  \"state\": \"" << State << "\",\n"
+        << "  \"elapsed_seconds\": " << Elapsed << ",\n"
+        << "  \"cpu_seconds\": " << StageClock::ProcessCpu() << ",\n"
+        << "  \"peak_rss_kb\": " << StageClock::PeakRss() << ",\n"
+        << "  \"threads\": " << Threads << ",\n"
+        << "  \"input\": {\"position\": " << (IsFile ? InputOffset() : 0) << ", \"size\": " << (IsFile ? filesize : 0)
+        << ", \"bytes\": " << Status.InputBytes << ", \"bytes_per_s\": " << Rate(Status.InputBytes)
+        << ", \"records\": " << Status.InputCounter << ", \"records_per_s\": " << Rate(Status.InputCounter) << "},\n"
+        << "  \"output\": {\"bytes\": " << Status.OutputBytes << ", \"bytes_per_s\": " << Rate(Status.OutputBytes)
+        << ", \"records\": " << Status.OutputCounter << ", \"records_per_s\": " << Rate(Status.OutputCounter) << "},\n"
+        << "  \"allocations\": {\"count\": " << AllocationCounter::Count() << ", \"bytes\": " << AllocationCounter::Bytes() << "},\n"
+        << "  \"stages\": {";
+    for(size_t i(0); i < STAGE_COUNT; i++)
+        sso << (i ? ", " : "") << "\"" << StageNames[i] << "\": {\"wall_seconds\": " << StageWall[i] << ", \"cpu_seconds\": " << StageCpu[i] << "}";
+    sso << "},\n"
+        << "  \"removed\": {\"multiallelic\": " << Status.RemovedMultiallelic << ", \"GCR\": " << Status.RemovedGenotypeCallRate
+        << ", \"MAF\": " << Status.RemovedMAF << ", \"DPR\": [";
+    for(size_t i(0); i < Status.RemovedDepthRate.size(); i++)
+        sso << (i ? ", " : "") << "{\"level\": " << DPRlevel[i] << ", \"rate\": " << DPRvalue[i] << ", \"count\": " << Status.RemovedDepthRate[i] << "}";
+    sso << "], \"GQR\": [";
+    for(size_t i(0); i < Status.RemovedQualityRate.size(); i++)
+        sso << (i ? ", " : "") << "{\"level\": " << GQRlevel[i] << ", \"rate\": " << GQRvalue[i] << ", \"count\": " << Status.RemovedQualityRate[i] << "}";
+    sso << "]}\n"
+        << "}\n";
+    std::string tmpFilename = MetricsFilename + ".tmp";
+    std::ofstream File(tmpFilename);
+    File << sso.str();
+    File.close();
+    if(!File || std::rename(tmpFilename.c_str(), MetricsFilename.c_str())!=0) Log("Can't write metrics file " + MetricsFilename);
+}
+void LCVCFtools::OutputSampleStatistics(){
+    if(!IsSampleStats || !SampleStatsFile.is_open()) return;
+    Log("Calculating sample statistics...");
+    const size_t nSamples = HeaderSamples.size();
+    std::vector<size_t> Order(nSamples);
+    std::iota(Order.begin(), Order.end(), 0);
+    std::sort(Order.begin(),Order.end(),[&](size_t a, size_t b)->bool{return SampleStats.NonMissing(a) > SampleStats.NonMissing(b);});
+    if(IsStatsSketch){
+        SampleStatsFile << "## NMR=Mean non-missing rate" << std::endl;
+        SampleStatsFile << "## MDP=Mean Depth" << std::endl;
+        SampleStatsFile << "## MGQ=Mean Quality" << std::endl;
+        SampleStatsFile << "## DP=Depth percentile (within 1/16 of the value above 15)" << std::endl;
+        SampleStatsFile << "## GQ=Genotype quality percentile (within 1/16 of the value above 15)" << std::endl;
+        SampleStatsFile << "Sample\tVariable\tLevel\tValue" << std::endl;
+        const std::pair<const char*,double> Percentiles[] = {{"p5", 0.05}, {"p50", 0.5}, {"p95", 0.95}};
+        for(size_t k : Order){
+            const std::string& SampleId = HeaderSamples[k];
+            SampleStatsFile << SampleId << "\t" << "NMR" << "\t.\t" << static_cast<double>(SampleStats.NonMissing(k))/Status.OutputCounter << std::endl;
+            SampleStatsFile << SampleId << "\t" << "MDP" << "\t.\t" << SampleStats.MeanDepth(k) << std::endl;
+            SampleStatsFile << SampleId << "\t" << "MGQ" << "\t.\t" << SampleStats.MeanQuality(k) << std::endl;
+            for(const auto& P : Percentiles)
+                SampleStatsFile << SampleId << "\t" << "DP" << "\t" << P.first << "\t" << SampleStats.DepthPercentile(k, P.second) << std::endl;
+            for(const auto& P : Percentiles)
+                SampleStatsFile << SampleId << "\t" << "GQ" << "\t" << P.first << "\t" << SampleStats.QualityPercentile(k, P.second) << std::endl;
+        }
+        return;
+    }
+    /*************
+        Means use the per-level counts, levels are then turned into
+        counts at or above each level, level 1 holds the total
+    *************/
+    std::vector<double> MeanDepth(nSamples, 0), MeanQuality(nSamples, 0);
+    for(size_t k(0); k < nSamples; k++){
+        uint64_t tmpDPsum = 0, tmpGQsum = 0;
+        for(int i(1); i < YLim+1; i++){
+            tmpDPsum += SampleStats.Depth(k, i);
+            tmpGQsum += SampleStats.Quality(k, i);
+        }
+        for(int i(1); i < YLim+1; i++) MeanDepth[k]+=static_cast<double>(SampleStats.Depth(k, i)*i)/tmpDPsum;
+        for(int i(1); i < YLim+1; i++) MeanQuality[k]+=static_cast<double>(SampleStats.Quality(k, i)*i)/tmpGQsum;
+    }
+    SampleStats.Accumulate();
+    SampleStatsFile << "## NMR=Mean non-missing rate" << std::endl;
+    SampleStatsFile << "## MDP=Mean Depth" << std::endl;
+    SampleStatsFile << "## MGQ=Mean Quality" << std::endl;
+    SampleStatsFile << "## DP=Depth at a given level" << std::endl;
+    SampleStatsFile << "## GQ=Genotype at a given level" << std::endl;
+    SampleStatsFile << "Sample\tVariable\tLevel\tValue" << std::endl;
+    for(size_t k : Order){
+        const std::string& SampleId = HeaderSamples[k];
+        uint64_t tmpDPsum = SampleStats.Depth(k, 1);
+        uint64_t tmpGQsum = SampleStats.Quality(k, 1);
+        SampleStatsFile << SampleId << "\t" << "NMR" << "\t.\t" << static_cast<double>(SampleStats.NonMissing(k))/Status.OutputCounter << std::endl;
+        SampleStatsFile << SampleId << "\t" << "MDP" << "\t.\t" << MeanDepth[k] << std::endl;
+        SampleStatsFile << SampleId << "\t" << "MGQ" << "\t.\t" << MeanQuality[k] << std::endl;
+        for(int i(1); i < YLim+1; i++){
+            double tmpValue = static_cast<double>(SampleStats.Depth(k, i))/tmpDPsum;
+            if(tmpValue < YLimThreshold) break;
+            SampleStatsFile << SampleId << "\t" << "DP" << "\t" << i << "\t" << tmpValue << std::endl;
+        }
+        for(int i(1); i < YLim+1; i++){
+            double tmpValue = static_cast<double>(SampleStats.Quality(k, i))/tmpGQsum;
+            if(tmpValue < YLimThreshold) break;
+            SampleStatsFile << SampleId << "\t" << "GQ" << "\t" << i << "\t" << tmpValue << std::endl;
+        }
+    }
+}
+void LCVCFtools::OutputHeader(){
+    std::ostringstream Header;
+    for(const auto& tmpString : CommentLines) Header << tmpString << '\n';
+    Header << "##LCVCFtools_v"
+           << THIS_VERSION
+           << " "
+           << GetParametersString()
+           << "Date="
+           << StartingTimeStr
+           << '\n';
+    std::string tmpHeaderString;
+    for(const auto& tmpString : HeaderColumns) tmpHeaderString += tmpString + '\t';
+    for(const auto& tmpString : HeaderSamples) tmpHeaderString += tmpString + '\t';
+    Header << tmpHeaderString.erase(tmpHeaderString.size()-1) << '\n';
+    WriteOutput(Header.str(), false);
+}
+void LCVCFtools::OpenOutputStream(){
+    if(OnRecord) return;
+    if(OutputFilename.empty()){
+        PlainWriter.reset(new BufferedWriter(STDOUT_FILENO));
+        return;
+    }
+    if(IsResumed){
+        ResumeOutput();
+        return;
+    }
+    size_t Dot = OutputFilename.find_last_of('.');
+    std::string Extension = Dot==std::string::npos ? "" : OutputFilename.substr(Dot);
+    if(Extension==".gz" || Extension==".bgz"){
+        Writer.reset(new BgzfWriter(OutputFilename, Threads));
+        if(!Writer->IsOpen()) Terminate("Output file is not writable");
+        OpenIndex();
+    }
+    else{
+        try{
+            PlainWriter.reset(new BufferedWriter(OutputFilename));
+        }
+        catch(const std::runtime_error& e){
+            Terminate(e.what());
+        }
+    }
+}
+void LCVCFtools::OpenIndex(){
+    /*************
+        CSI depth follows the longest ##contig, TBI stops at 2^29
+    *************/
+    uint64_t MaxLength = 0;
+    for(const std::string& Line : CommentLines){
+        if(Line.compare(0, 10, "##contig=<")) continue;
+        size_t i = Line.find("length=");
+        if(i!=std::string::npos) MaxLength = std::max<uint64_t>(MaxLength, std::strtoull(Line.c_str()+i+7, nullptr, 10));
+    }
+    Index.reset(new TabixIndex(IsCsi, 14, TabixIndex::DepthFor(MaxLength)));
+    Log("Writing BGZF output with " + std::string(IsCsi ? ".csi" : ".tbi") + " index...");
+}
+void LCVCFtools::WriteOutput(const std::string& Data, bool IsRecords){
+    /******* Sweep and build-cache runs have no output stream *******/
+    if(Data.empty()) return;
+    if(OnRecord){
+        if(IsRecords) SendRecords(Data);
+        else if(OnHeader) OnHeader(Data);
+        return;
+    }
+    try{
+        if(!Writer){
+            PlainWriter->Write(Data.data(), Data.size());
+            return;
+        }
+        if(!IsRecords || !Index){
+            Writer->Write(Data.data(), Data.size());
+            return;
+        }
+        for(size_t Begin = 0, End; Begin < Data.size(); Begin = End+1){
+            End = Data.find('\n', Begin);
+            if(End==std::string::npos) End = Data.size()-1;
+            uint64_t Offset = Writer->Tell();
+            Writer->Write(Data.data()+Begin, End-Begin+1);
+            if(!Index->Push(Data.data()+Begin, End-Begin, Offset, Writer->Tell())){
+                /******* An index left from an earlier run would not match the new output *******/
+                Warn("Output is not sorted or exceeds the index range, index will not be written");
+                std::remove((OutputFilename + (IsCsi ? ".csi" : ".tbi")).c_str());
+                Index.reset();
+                Writer->Write(Data.data()+End+1, Data.size()-End-1);
+                return;
+            }
+        }
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+}
+void LCVCFtools::SendRecords(const std::string& Data){
+    /*************
+        Output lines are split back into columns for the callback,
+        samples stay one tab separated view
+    *************/
+    RecordView View;
+    boost::string_view* Columns[] = {&View.CHR, &View.POS, &View.ID, &View.REF, &View.ALT,
+                                     &View.QUAL, &View.FILTER, &View.INFO, &View.FORMAT};
+    for(const char *p = Data.data(), *end = p + Data.size(), *q; p < end; p = q+1){
+        q = static_cast<const char*>(std::memchr(p, '\n', end-p));
+        if(!q) q = end;
+        View.Line = boost::string_view(p, q-p);
+        const char *f = p, *g;
+        for(boost::string_view* Column : Columns){
+            g = static_cast<const char*>(std::memchr(f, '\t', q-f));
+            if(!g) g = q;
+            *Column = boost::string_view(f, g-f);
+            f = std::min(g+1, q);
+        }
+        View.Samples = boost::string_view(f, q-f);
+        OnRecord(View);
+    }
+}
+void LCVCFtools::CloseOutputStream(){
+    try{
+        if(PlainWriter) PlainWriter->Close();
+        if(!Writer) return;
+        Writer->Close();
+        if(Index){
+            Log("Writing index...");
+            Index->Save(OutputFilename + (IsCsi ? ".csi" : ".tbi"), *Writer);
+        }
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+}
+void LCVCFtools::OutputLine(WorkerStruct& W){
+    std::string& tmpString = W.Output;
+    const SnpDataStruct& D = W.SnpData;
+    const boost::string_view Columns[] = {D.CHR, D.POS, D.ID, D.REF, D.ALT, D.QUAL, D.FILTER, D.INFO, D.FORMATstr};
+    for(size_t i(0); i < 9; i++){
+        const boost::string_view& Column = Columns[i];
+        /******* --ID is written in place as CHR:POS:REF:ALT *******/
+        if(i==2 && IsID){
+            for(const boost::string_view& Part : {D.CHR, D.POS, D.REF, D.ALT}){
+                tmpString.append(Part.data(), Part.size());
+                tmpString += ':';
+            }
+            tmpString.back() = '\t';
+            continue;
+        }
+        tmpString.append(Column.data(), Column.size());
+        tmpString += '\t';
+    }
+    tmpString.pop_back();
+    /******* Chunks format their samples in parallel, appended in order *******/
+    if(!SampleChunks.empty()){
+        RunChunks(CHUNK_OUTPUT);
+        for(size_t c(1); c < SampleChunks.size(); c++) tmpString += Workers[c].Output;
+    }
+    else for(const auto& SAMPLE : W.SnpData.SampleDataVector){
+        tmpString += '\t';
+        OutputSample(W, SAMPLE);
+    }
+    tmpString += '\n';
+}
+void LCVCFtools::OutputSample(WorkerStruct& W, const SampleDataStruct& Sample){
+    std::string& tmpString = W.Output;
+    if(!W.SnpData.IsBcf){
+        /*************
+            Samples left untouched by the filters are copied as the
+            input bytes, only rewritten ones are split into fields
+        *************/
+        if(!Sample.IsMissingGT && !Sample.IsZeroed){
+            tmpString.append(Sample.Text.data(), Sample.Text.size());
+            return;
+        }
+        const char *p = Sample.Text.begin(), *end = Sample.Text.end(), *q;
+        for(size_t i(0); ; i++, p = q+1){
+            q = static_cast<const char*>(std::memchr(p, ':', end-p));
+            if(!q) q = end;
+            if(i) tmpString += ':';
+            if(Sample.IsMissingGT && i==W.Layout->GTslot) tmpString += "./.";
+            else if(Sample.IsZeroed && i==W.Layout->GQslot) tmpString += '0';
+            else if(Sample.IsZeroed && (i==W.Layout->PLslot || i==W.Layout->ADslot)){
+                boost::string_view Zeros = ZeroList(W, std::count(p, q, ','));
+                tmpString.append(Zeros.data(), Zeros.size());
+            }
+            else tmpString.append(p, q-p);
+            if(q==end) break;
+        }
+        return;
+    }
+    const size_t nTags = W.Layout->Tags.size();
+    for(size_t i(0); i < nTags; i++){
+        if(i) tmpString += ':';
+        if(Sample.IsMissingGT && i==W.Layout->GTslot){
+            tmpString += "./.";
+            continue;
+        }
+        if(Sample.IsZeroed && i==W.Layout->GQslot){
+            tmpString += '0';
+            continue;
+        }
+        if(Sample.IsZeroed && (i==W.Layout->PLslot || i==W.Layout->ADslot)){
+            boost::string_view Zeros = ZeroList(W, SampleSeparators(W, Sample, i));
+            tmpString.append(Zeros.data(), Zeros.size());
+            continue;
+        }
+        const BcfDecoder::TypedStruct& Field = W.SnpData.BcfFORMAT[i];
+        const char* Data = Field.Data + Sample.Column*Field.Count*BcfDecoder::TypeSize(Field.Type);
+        if(i==W.Layout->GTslot) BcfDecoder::AppendGenotype(tmpString, Field.Type, Data, Field.Count);
+        else BcfDecoder::AppendValues(tmpString, Field.Type, Data, Field.Count);
+    }
+}
@@ -0,0 +1,309 @@
+#include "lcvcftools.h"
+#include <climits>
+int LCVCFtools::StringToInt(boost::string_view String){
+    if(String.find('.')!=boost::string_view::npos) return -1;
+    auto it = String.begin();
+    bool IsNegative = false;
+    if(it!=String.end() && (*it=='-' || *it=='+')) IsNegative = (*it++=='-');
+    if(it==String.end()) Terminate("Invalid integer value '" + String.to_string() + "'");
+    int Value = 0;
+    for(; it!=String.end(); ++it){
+        if(*it<'0' || *it>'9' || Value > (INT_MAX-(*it-'0'))/10) Terminate("Invalid integer value '" + String.to_string() + "'");
+        Value = Value*10 + (*it-'0');
+    }
+    return IsNegative ? -Value : Value;
+}
+int LCVCFtools::ParseInt(const char* Begin, const char* End){
+    /*************
+        Plain digits are the common case, anything else ('.', signs,
+        invalid values) goes through StringToInt
+    *************/
+    if(Begin < End && End-Begin <= 9){
+        int Value = 0;
+        const char* p = Begin;
+        for(; p < End && static_cast<unsigned>(*p-'0') < 10; p++) Value = Value*10 + (*p-'0');
+        if(p==End) return Value;
+    }
+    return StringToInt(boost::string_view(Begin, End-Begin));
+}
+void LCVCFtools::ParseInts(const char* Begin, const char* End, std::vector<int>& Values){
+    for(const char *p = Begin, *q; ; p = q+1){
+        q = static_cast<const char*>(std::memchr(p, ',', End-p));
+        if(!q) q = End;
+        Values.push_back(ParseInt(p, q));
+        if(q==End) break;
+    }
+}
+void LCVCFtools::SetFORMAT(WorkerStruct& W){
+    /*************
+        Compiled layouts are cached by FORMAT hash, so files mixing
+        several layouts only split each FORMAT string once
+    *************/
+    const boost::string_view& FORMATstr = W.SnpData.FORMATstr;
+    if(W.Layout && W.Layout->FORMATstr==FORMATstr) return;
+    size_t Hash = boost::hash_range(FORMATstr.begin(), FORMATstr.end());
+    for(const FormatLayoutStruct& Layout : W.FormatLayouts){
+        if(Layout.Hash==Hash && Layout.FORMATstr==FORMATstr){
+            W.Layout = &Layout;
+            return;
+        }
+    }
+    W.CacheMisses++;
+    if(W.FormatLayouts.size() >= MaxFormatLayouts) W.FormatLayouts.clear();
+    W.FormatLayouts.emplace_back();
+    FormatLayoutStruct& Layout = W.FormatLayouts.back();
+    Layout.Hash = Hash;
+    Layout.FORMATstr = FORMATstr.to_string();
+    std::map<std::string,size_t> FORMATtagsMap;
+    std::set<std::string> RequiredTags = {"GQ","DP","AD","GT","PL"};
+    boost::split(Layout.Tags, Layout.FORMATstr, boost::algorithm::is_any_of(":"));
+    for(size_t i(0); i < Layout.Tags.size(); i++){
+        FORMATtagsMap[Layout.Tags[i]] = i;
+        RequiredTags.erase(Layout.Tags[i]);
+    }
+    if(!RequiredTags.empty()){
+        W.FormatLayouts.pop_back();
+        W.Layout = nullptr;
+        std::string tmpMsg = "Missing VCF required tag(s): ";
+        for(std::string s : RequiredTags) tmpMsg += s + "; ";
+        Terminate(tmpMsg);
+    }
+    Layout.GTslot = FORMATtagsMap["GT"];
+    Layout.PLslot = FORMATtagsMap["PL"];
+    Layout.DPslot = FORMATtagsMap["DP"];
+    Layout.ADslot = FORMATtagsMap["AD"];
+    Layout.GQslot = FORMATtagsMap["GQ"];
+    W.Layout = &Layout;
+}
+bool LCVCFtools::BcfToVcf(WorkerStruct& W, boost::string_view tmpRecord){
+    /*************
+        Site columns are formatted into SiteBuffer, sample columns stay
+        typed in tmpRecord and are only formatted by OutputLine()
+    *************/
+    const char *p = tmpRecord.data(), *end = p + tmpRecord.size();
+    uint32_t l_shared;
+    std::memcpy(&l_shared, p, 4);
+    const char *indiv = p + 8 + l_shared;
+    if(l_shared < 24 || indiv > end) return false;
+    int32_t CHROM, POS;
+    float QUAL;
+    uint32_t n_allele_info, n_fmt_sample;
+    std::memcpy(&CHROM, p+8, 4);
+    std::memcpy(&POS, p+12, 4);
+    std::memcpy(&QUAL, p+20, 4);
+    std::memcpy(&n_allele_info, p+24, 4);
+    std::memcpy(&n_fmt_sample, p+28, 4);
+    size_t n_info = n_allele_info & 0xFFFF, n_allele = n_allele_info >> 16;
+    size_t n_sample = n_fmt_sample & 0xFFFFFF, n_fmt = n_fmt_sample >> 24;
+    if(CHROM < 0 || size_t(CHROM) >= Bcf.Contigs.size()) Terminate("BCF contig index " + std::to_string(CHROM) + " not in header");
+    if(n_sample!=InputSamples) Terminate("Incorrect number of samples in BCF record");
+    W.SnpData.IsBcf = true;
+    std::string& B = W.SnpData.SiteBuffer;
+    B.clear();
+    size_t Offsets[10];
+    BcfDecoder::TypedStruct Value;
+    try{
+        const char* q = p + 32;
+        Offsets[0] = B.size();
+        B += Bcf.Contigs[CHROM];
+        Offsets[1] = B.size();
+        B += std::to_string(POS+1);
+        Offsets[2] = B.size();
+        q = BcfDecoder::ReadTyped(q, indiv, Value);
+        BcfDecoder::AppendValues(B, BcfDecoder::BT_CHAR, Value.Data, Value.Count);
+        Offsets[3] = B.size();
+        for(size_t i(0); i < n_allele; i++){
+            q = BcfDecoder::ReadTyped(q, indiv, Value);
+            if(i > 1) B += ',';
+            BcfDecoder::AppendValues(B, BcfDecoder::BT_CHAR, Value.Data, Value.Count);
+            if(i==0) Offsets[4] = B.size();
+        }
+        if(n_allele==0) Offsets[4] = B.size();
+        if(n_allele < 2) B += '.';
+        Offsets[5] = B.size();
+        BcfDecoder::AppendFloat(B, QUAL);
+        Offsets[6] = B.size();
+        q = BcfDecoder::ReadTyped(q, indiv, Value);
+        if(Value.Count==0) B += '.';
+        for(size_t i(0); i < Value.Count; i++){
+            int32_t Key = BcfDecoder::GetInt(Value.Type, Value.Data, i);
+            if(Key < 0 || size_t(Key) >= Bcf.Strings.size()) Terminate("BCF FILTER index not in header");
+            if(i) B += ';';
+            B += Bcf.Strings[Key];
+        }
+        Offsets[7] = B.size();
+        if(n_info==0) B += '.';
+        for(size_t i(0); i < n_info; i++){
+            q = BcfDecoder::ReadTyped(q, indiv, Value);
+            int32_t Key = BcfDecoder::GetInt(Value.Type, Value.Data, 0);
+            if(Key < 0 || size_t(Key) >= Bcf.Strings.size()) Terminate("BCF INFO index not in header");
+            if(i) B += ';';
+            B += Bcf.Strings[Key];
+            q = BcfDecoder::ReadTyped(q, indiv, Value);
+            if(Value.Type==BcfDecoder::BT_NULL || Value.Count==0) continue;
+            B += '=';
+            BcfDecoder::AppendValues(B, Value.Type, Value.Data, Value.Count);
+        }
+        Offsets[8] = B.size();
+        W.SnpData.BcfFORMAT.clear();
+        q = indiv;
+        for(size_t i(0); i < n_fmt; i++){
+            q = BcfDecoder::ReadTyped(q, end, Value);
+            int32_t Key = BcfDecoder::GetInt(Value.Type, Value.Data, 0);
+            if(Key < 0 || size_t(Key) >= Bcf.Strings.size()) Terminate("BCF FORMAT index not in header");
+            if(i) B += ':';
+            B += Bcf.Strings[Key];
+            q = BcfDecoder::ReadDescriptor(q, end, Value);
+            q += n_sample*Value.Count*BcfDecoder::TypeSize(Value.Type);
+            if(q > end) return false;
+            W.SnpData.BcfFORMAT.push_back(Value);
+        }
+        Offsets[9] = B.size();
+    }
+    catch(const std::runtime_error& e){
+        Terminate(e.what());
+    }
+    boost::string_view* Columns[] = {&W.SnpData.CHR, &W.SnpData.POS, &W.SnpData.ID,
+                                     &W.SnpData.REF, &W.SnpData.ALT, &W.SnpData.QUAL,
+                                     &W.SnpData.FILTER, &W.SnpData.INFO, &W.SnpData.FORMATstr};
+    for(size_t i(0); i < 9; i++) *Columns[i] = boost::string_view(B.data()+Offsets[i], Offsets[i+1]-Offsets[i]);
+    if(!SetAlleles(W)) return true;
+    SetFORMAT(W);
+    W.SnpData.SampleDataVector.reserve(HeaderSamples.size());
+    for(size_t i : KeepColumns){
+        SampleDataStruct tmpSample;
+        tmpSample.Column = i;
+        W.SnpData.SampleDataVector.push_back(tmpSample);
+    }
+    /******* Typed sample values need no splitting, chunks take equal shares *******/
+    for(size_t c(0); c < SampleChunks.size(); c++){
+        SampleChunks[c].FirstSample = c*KeepColumns.size()/SampleChunks.size();
+        SampleChunks[c].LastSample = (c+1)*KeepColumns.size()/SampleChunks.size();
+    }
+    return true;
+}
+bool LCVCFtools::SetAlleles(WorkerStruct& W){
+    size_t nAlleles = std::count(W.SnpData.ALT.begin(), W.SnpData.ALT.end(), ',') + 2;
+    W.SnpData.AlleleCountVector.assign(nAlleles, 0);
+    return !(IsRemoveMultiallelic && !IsBuildCache && nAlleles > 2);
+}
+bool LCVCFtools::StringToVcf(WorkerStruct& W, boost::string_view tmpLineString){
+    /*************
+        Columns and sample columns are views into tmpLineString,
+        which must stay alive until OutputLine(). Only the fields
+        the filters need are decoded, multiallelic sites that will
+        be removed stop after the site columns.
+    *************/
+    const char *p = tmpLineString.data(), *end = p + tmpLineString.size(), *q;
+    boost::string_view* Columns[] = {&W.SnpData.CHR, &W.SnpData.POS, &W.SnpData.ID,
+                                     &W.SnpData.REF, &W.SnpData.ALT, &W.SnpData.QUAL,
+                                     &W.SnpData.FILTER, &W.SnpData.INFO, &W.SnpData.FORMATstr};
+    bool HasSamples = true;
+    for(size_t i(0); i < 9; i++){
+        q = static_cast<const char*>(std::memchr(p, '\t', end-p));
+        if(!q){
+            if(i < 8) Terminate("Invalid number of columns");
+            q = end;
+            HasSamples = false;
+        }
+        *Columns[i] = boost::string_view(p, q-p);
+        p = q+1;
+    }
+    if(!SetAlleles(W)) return true;
+    SetFORMAT(W);
+    /******* With --split-samples the chunks split the sample columns *******/
+    if(!SampleChunks.empty()) return SplitColumns(W, HasSamples ? boost::string_view(p, end-p) : boost::string_view());
+    if(!HasSamples) return KeepColumns.empty();
+    W.SnpData.SampleDataVector.resize(KeepColumns.size());
+    return SplitSamples(*W.Layout, p, end, 0, 0, KeepColumns.size(), W.SnpData.SampleDataVector.data());
+}
+bool LCVCFtools::SplitSamples(const FormatLayoutStruct& Layout, const char* p, const char* end, size_t Column,
+                              size_t First, size_t Last, SampleDataStruct* Samples){
+    /*************
+        Kept sample columns First to Last, the first one at or after
+        input column Column which starts at p, are split with the
+        delimiter kernel. DP, GQ and AD are kept as views and parsed
+        by Filter(). Dropped columns are jumped over and nothing
+        after the last kept one is read.
+    *************/
+    const size_t nTags = Layout.Tags.size();
+    const char* q;
+    bool HasSamples = true;
+    DelimiterCursor Cursor(p, end);
+    for(size_t s(First); s < Last; s++){
+        const size_t Keep = KeepColumns[s];
+        if(!HasSamples) return false;
+        if(Column < Keep){
+            for(; Column < Keep; Column++){
+                q = static_cast<const char*>(std::memchr(p, '\t', end-p));
+                if(!q) return false;
+                p = q+1;
+            }
+            Cursor.Seek(p);
+        }
+        SampleDataStruct& tmpSample = Samples[s];
+        tmpSample.Column = Column++;
+        size_t nFields = 0;
+        for(const char *f = p, *g; ; f = g+1){
+            g = Cursor.Next();
+            bool IsLast = (g==end || *g=='\t');
+            if(IsLast && g==p) return false;
+            if(nFields==Layout.DPslot) tmpSample.DP = boost::string_view(f, g-f);
+            else if(nFields==Layout.GQslot) tmpSample.GQ = boost::string_view(f, g-f);
+            else if(nFields==Layout.ADslot) tmpSample.AD = boost::string_view(f, g-f);
+            nFields++;
+            if(IsLast){
+                tmpSample.Text = boost::string_view(p, g-p);
+                HasSamples = (g!=end);
+                p = g+1;
+                break;
+            }
+        }
+        if(nFields!=nTags) Terminate("Incorrect number of fields for FORMAT");
+    }
+    return true;
+}
+int LCVCFtools::SampleInt(WorkerStruct& W, const SampleDataStruct& Sample, size_t Slot){
+    const BcfDecoder::TypedStruct& Field = W.SnpData.BcfFORMAT[Slot];
+    if(Field.Count==0) return -1;
+    int32_t Value = 0;
+    try{
+        Value = BcfDecoder::GetInt(Field.Type, Field.Data, Sample.Column*Field.Count);
+    }
+    catch(const std::runtime_error& e){
+        Terminate(std::string(e.what()) + " at " + W.SnpData.CHR.to_string() + ":" + W.SnpData.POS.to_string());
+    }
+    if(Value==BcfDecoder::IntMissing || Value==BcfDecoder::IntVectorEnd) return -1;
+    return Value;
+}
+void LCVCFtools::SampleInts(WorkerStruct& W, const SampleDataStruct& Sample, size_t Slot, std::vector<int>& Values){
+    const BcfDecoder::TypedStruct& Field = W.SnpData.BcfFORMAT[Slot];
+    const char* Data = Field.Data + Sample.Column*Field.Count*BcfDecoder::TypeSize(Field.Type);
+    size_t n = BcfDecoder::CountValues(Field.Type, Data, Field.Count);
+    if(n==0) Values.push_back(-1);
+    try{
+        for(size_t i(0); i < n; i++){
+            int32_t Value = BcfDecoder::GetInt(Field.Type, Data, i);
+            Values.push_back(Value==BcfDecoder::IntMissing ? -1 : Value);
+        }
+    }
+    catch(const std::runtime_error& e){
+        Terminate(std::string(e.what()) + " at " + W.SnpData.CHR.to_string() + ":" + W.SnpData.POS.to_string());
+    }
+}
+size_t LCVCFtools::SampleSeparators(WorkerStruct& W, const SampleDataStruct& Sample, size_t Slot){
+    const BcfDecoder::TypedStruct& Field = W.SnpData.BcfFORMAT[Slot];
+    const char* Data = Field.Data + Sample.Column*Field.Count*BcfDecoder::TypeSize(Field.Type);
+    size_t n = BcfDecoder::CountValues(Field.Type, Data, Field.Count);
+    return n ? n-1 : 0;
+}
+void LCVCFtools::DecodeSample(WorkerStruct& W, const SampleDataStruct& Sample, int& DP, int& GQ){
+    if(W.SnpData.IsBcf){
+        DP = SampleInt(W, Sample, W.Layout->DPslot);
+        GQ = SampleInt(W, Sample, W.Layout->GQslot);
+    }
+    else{
+        DP = ParseInt(Sample.DP.begin(), Sample.DP.end());
+        GQ = ParseInt(Sample.GQ.begin(), Sample.GQ.end());
+    }
+}
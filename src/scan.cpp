@@ -0,0 +1,110 @@
+#include "scan.h"
+#include <algorithm>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+static inline uint64_t ScanWord(const char* Data, size_t Size){
+    uint64_t Bits = 0;
+    for(size_t i(0); i < Size; i++)
+        if(Data[i]=='\t' || Data[i]==':') Bits |= uint64_t(1) << i;
+    return Bits;
+}
+void DelimiterScanner::ScanScalar(const char* Data, size_t Size, uint64_t* Mask){
+    for(size_t i(0); i < Size; i += 64) *Mask++ = ScanWord(Data+i, std::min<size_t>(64, Size-i));
+}
+#ifdef SCAN_X86
+__attribute__((target("sse2")))
+void DelimiterScanner::ScanSse2(const char* Data, size_t Size, uint64_t* Mask){
+    const __m128i Tab = _mm_set1_epi8('\t'), Colon = _mm_set1_epi8(':');
+    size_t i = 0;
+    for(; i+64 <= Size; i += 64){
+        uint64_t Bits = 0;
+        for(size_t j(0); j < 64; j += 16){
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Data+i+j));
+            __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, Tab), _mm_cmpeq_epi8(v, Colon));
+            Bits |= uint64_t(uint16_t(_mm_movemask_epi8(m))) << j;
+        }
+        *Mask++ = Bits;
+    }
+    if(i < Size) *Mask = ScanWord(Data+i, Size-i);
+}
+__attribute__((target("avx2")))
+void DelimiterScanner::ScanAvx2(const char* Data, size_t Size, uint64_t* Mask){
+    const __m256i Tab = _mm256_set1_epi8('\t'), Colon = _mm256_set1_epi8(':');
+    size_t i = 0;
+    for(; i+64 <= Size; i += 64){
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Data+i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Data+i+32));
+        __m256i ma = _mm256_or_si256(_mm256_cmpeq_epi8(a, Tab), _mm256_cmpeq_epi8(a, Colon));
+        __m256i mb = _mm256_or_si256(_mm256_cmpeq_epi8(b, Tab), _mm256_cmpeq_epi8(b, Colon));
+        *Mask++ = uint64_t(uint32_t(_mm256_movemask_epi8(ma))) | (uint64_t(uint32_t(_mm256_movemask_epi8(mb))) << 32);
+    }
+    if(i < Size) *Mask = ScanWord(Data+i, Size-i);
+}
+#else
+void DelimiterScanner::ScanSse2(const char* Data, size_t Size, uint64_t* Mask){
+    ScanScalar(Data, Size, Mask);
+}
+void DelimiterScanner::ScanAvx2(const char* Data, size_t Size, uint64_t* Mask){
+    ScanScalar(Data, Size, Mask);
+}
+#endif
+DelimiterScanner::KernelFunction DelimiterScanner::Select(){
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return &ScanAvx2;
+    if(__builtin_cpu_supports("sse2")) return &ScanSse2;
+#endif
+    return &ScanScalar;
+}
+DelimiterScanner::KernelFunction DelimiterScanner::Function(){
+    static const KernelFunction Selected = Select();
+    return Selected;
+}
+void DelimiterScanner::Scan(const char* Data, size_t Size, uint64_t* Mask){
+    if(Size) Function()(Data, Size, Mask);
+}
+std::string DelimiterScanner::Kernel(){
+    KernelFunction Function = Select();
+    if(Function==&ScanAvx2) return "AVX2";
+    if(Function==&ScanSse2) return "SSE2";
+    return "scalar";
+}
+DelimiterCursor::DelimiterCursor(const char* Begin, const char* End) : Base(Begin), End(End){
+    Fill();
+}
+void DelimiterCursor::Fill(){
+    size_t Size = std::min<size_t>(BlockWords*64, End > Base ? End-Base : 0);
+    Words = (Size+63)/64;
+    Word = 0;
+    Bits = 0;
+    if(Size){
+        DelimiterScanner::Scan(Base, Size, Mask);
+        Bits = Mask[0];
+    }
+}
+const char* DelimiterCursor::Next(){
+    while(!Bits){
+        if(++Word >= Words){
+            if(Words==0) return End;
+            Base += Words*64;
+            Fill();
+            continue;
+        }
+        Bits = Mask[Word];
+    }
+    const char* Position = Base + Word*64 + __builtin_ctzll(Bits);
+    Bits &= Bits-1;
+    return Position;
+}
+void DelimiterCursor::Seek(const char* Position){
+    size_t Offset = Position - Base;
+    if(Position >= Base && Offset < Words*64){
+        Word = Offset/64;
+        Bits = Mask[Word] & (~uint64_t(0) << (Offset%64));
+        return;
+    }
+    Base = Position;
+    Fill();
+}
@@ -0,0 +1,43 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <string>
+#include <cstdint>
+#include <cstddef>
+/*************
+    Marks tab and colon positions of a line in 64-bit masks (bit i of
+    word i/64 for byte i), the widest kernel supported by the CPU is
+    selected at runtime. Mask must hold (Size+63)/64 words.
+*************/
+class DelimiterScanner
+{
+public:
+    static void Scan(const char* Data, size_t Size, uint64_t* Mask);
+    static std::string Kernel();
+private:
+    typedef void (*KernelFunction)(const char*, size_t, uint64_t*);
+    static KernelFunction Select();
+    static KernelFunction Function();
+    static void ScanScalar(const char* Data, size_t Size, uint64_t* Mask);
+    static void ScanSse2(const char* Data, size_t Size, uint64_t* Mask);
+    static void ScanAvx2(const char* Data, size_t Size, uint64_t* Mask);
+};
+/*************
+    Walks tab and colon positions of [Begin, End), scanning one block
+    at a time so columns that are jumped over with Seek() are never
+    scanned.
+*************/
+class DelimiterCursor
+{
+public:
+    DelimiterCursor(const char* Begin, const char* End);
+    static const size_t BlockWords = 16;
+    const char* Next();
+    void Seek(const char* Position);
+private:
+    void Fill();
+    const char *Base, *End;
+    uint64_t Mask[BlockWords];
+    size_t Words = 0, Word = 0;
+    uint64_t Bits = 0;
+};
+#endif
@@ -0,0 +1,139 @@
+#include "lcvcftools.h"
+void LCVCFtools::StartChunks(){
+    /*************
+        The reading thread takes chunk 0 with Workers[0], which holds
+        the record, chunk threads take the others with their own
+        worker for scratch buffers and output
+    *************/
+    SampleChunks.resize(Threads);
+    IsQueueClosed = false;
+    ChunkGeneration = ChunksPending = 0;
+    for(size_t i(1); i < Threads; i++) ChunkThreads.emplace_back(&LCVCFtools::ChunkThread, this, i);
+    Log("Splitting the samples of each record in " + std::to_string(Threads) + " chunks...");
+}
+void LCVCFtools::StopChunks(){
+    {
+        std::lock_guard<std::mutex> Lock(QueueMutex);
+        IsQueueClosed = true;
+    }
+    QueueCV.notify_all();
+    for(std::thread& T : ChunkThreads) T.join();
+    ChunkThreads.clear();
+    SampleChunks.clear();
+}
+void LCVCFtools::ChunkThread(size_t Index){
+    size_t Generation = 0;
+    while(true){
+        {
+            std::unique_lock<std::mutex> Lock(QueueMutex);
+            QueueCV.wait(Lock, [&]{return ChunkGeneration!=Generation || IsQueueClosed;});
+            if(IsQueueClosed) return;
+            Generation = ChunkGeneration;
+        }
+        try{
+            ProcessChunk(Index);
+        }
+        catch(...){
+            std::lock_guard<std::mutex> Lock(QueueMutex);
+            if(!WorkerError) WorkerError = std::current_exception();
+        }
+        std::lock_guard<std::mutex> Lock(QueueMutex);
+        if(--ChunksPending==0) DoneCV.notify_one();
+    }
+}
+void LCVCFtools::RunChunks(ChunkPhaseEnum Phase){
+    /*************
+        Every chunk runs Phase once, the reading thread returns when
+        all of them are done so the next phase sees their results
+    *************/
+    {
+        std::lock_guard<std::mutex> Lock(QueueMutex);
+        ChunkPhase = Phase;
+        ChunksPending = SampleChunks.size()-1;
+        ChunkGeneration++;
+    }
+    QueueCV.notify_all();
+    std::exception_ptr Error;
+    try{
+        ProcessChunk(0);
+    }
+    catch(...){
+        Error = std::current_exception();
+    }
+    std::unique_lock<std::mutex> Lock(QueueMutex);
+    DoneCV.wait(Lock, [&]{return ChunksPending==0;});
+    if(Error) std::rethrow_exception(Error);
+    if(WorkerError) std::rethrow_exception(WorkerError);
+}
+void LCVCFtools::ProcessChunk(size_t Index){
+    SampleChunkStruct& C = SampleChunks[Index];
+    WorkerStruct& Record = Workers[0];
+    WorkerStruct& W = Workers[Index];
+    std::vector<SampleDataStruct>& Samples = Record.SnpData.SampleDataVector;
+    if(Index){
+        /******* Values are decoded with the layout of the record *******/
+        W.SnpData.IsBcf = Record.SnpData.IsBcf;
+        W.SnpData.BcfFORMAT = Record.SnpData.BcfFORMAT;
+        W.Layout = Record.Layout;
+    }
+    switch(ChunkPhase){
+    case CHUNK_COLUMNS:
+        C.Columns = 0;
+        if(C.Begin==C.End) break;
+        for(const char* p = C.Begin; (p = static_cast<const char*>(std::memchr(p, '\t', C.End-p))); p++) C.Columns++;
+        if(C.End[-1]!='\t') C.Columns++;
+        break;
+    case CHUNK_TOKENS:
+        C.IsValid = SplitSamples(*Record.Layout, C.Begin, C.End, C.FirstColumn, C.FirstSample, C.LastSample, Samples.data());
+        break;
+    case CHUNK_SAMPLES:
+        C.FilterCounts.assign(1+DPRlevel.size()+GQRlevel.size(), 0);
+        DecodeSamples(W, Record, C.FirstSample, C.LastSample, C.FilterCounts.data());
+        break;
+    case CHUNK_ALLELES:
+        ReadAlleles(W, Record, C.FirstSample, C.LastSample);
+        break;
+    case CHUNK_OUTPUT:
+        /******* Chunk 0 writes after the site columns of the record *******/
+        if(Index) W.Output.clear();
+        for(size_t k(C.FirstSample); k < C.LastSample; k++){
+            W.Output += '\t';
+            OutputSample(W, Samples[k]);
+        }
+        if(IsSampleStats)
+            for(size_t k(C.FirstSample); k < C.LastSample; k++) Record.SampleStats.Add(k, Record.DPvalues[k], Record.GQvalues[k]);
+        break;
+    }
+}
+bool LCVCFtools::SplitColumns(WorkerStruct& W, boost::string_view Columns){
+    /*************
+        Each chunk ends after the first tab past an equal share of the
+        sample bytes. Chunks count their columns, which places their
+        kept samples, and then split them.
+    *************/
+    const char *p = Columns.data(), *end = p + Columns.size();
+    const size_t nChunks = SampleChunks.size();
+    for(size_t c(0); c < nChunks; c++){
+        SampleChunkStruct& C = SampleChunks[c];
+        C.Begin = c ? SampleChunks[c-1].End : p;
+        C.End = end;
+        if(c+1==nChunks || C.Begin==end) continue;
+        const char* q = std::max(C.Begin, p + (c+1)*Columns.size()/nChunks);
+        q = static_cast<const char*>(std::memchr(q, '\t', end-q));
+        if(q) C.End = q+1;
+    }
+    RunChunks(CHUNK_COLUMNS);
+    size_t Column = 0, Sample = 0;
+    for(SampleChunkStruct& C : SampleChunks){
+        C.FirstColumn = Column;
+        Column += C.Columns;
+        C.FirstSample = Sample;
+        Sample = std::lower_bound(KeepColumns.begin()+Sample, KeepColumns.end(), Column) - KeepColumns.begin();
+        C.LastSample = Sample;
+    }
+    if(Sample < KeepColumns.size()) return false;
+    W.SnpData.SampleDataVector.resize(KeepColumns.size());
+    RunChunks(CHUNK_TOKENS);
+    for(const SampleChunkStruct& C : SampleChunks) if(!C.IsValid) return false;
+    return true;
+}
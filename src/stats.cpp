@@ -0,0 +1,110 @@
+#include "stats.h"
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+template<typename T> static void Append(std::string& Out, T Value){
+    for(size_t i(0); i < sizeof(T); i++) Out += char((static_cast<uint64_t>(Value) >> (8*i)) & 0xFF);
+}
+template<typename T> static T Extract(const std::string& In, size_t& Pos){
+    if(Pos + sizeof(T) > In.size()) throw std::runtime_error("Truncated sample statistics");
+    uint64_t Value = 0;
+    for(size_t i(0); i < sizeof(T); i++) Value |= uint64_t(static_cast<unsigned char>(In[Pos+i])) << (8*i);
+    Pos += sizeof(T);
+    return static_cast<T>(Value);
+}
+SampleStatistics::SampleStatistics(size_t Samples, int Limit, bool IsSketch){
+    Reset(Samples, Limit, IsSketch);
+}
+void SampleStatistics::Reset(size_t Samples, int Limit, bool IsSketch){
+    this->IsSketch = IsSketch;
+    Levels = IsSketch ? SketchLevels : Limit+1;
+    RowSize = 2*Levels+3;
+    Counts.assign(Samples*RowSize, 0);
+}
+void SampleStatistics::Merge(const SampleStatistics& Other){
+    if(Other.IsSketch!=IsSketch || Other.Levels!=Levels || Other.Counts.size()!=Counts.size())
+        throw std::runtime_error("Sample statistics with different samples or limits can't be merged");
+    for(size_t i(0); i < Counts.size(); i++) Counts[i] += Other.Counts[i];
+}
+void SampleStatistics::SaveState(std::string& Out) const{
+    Append<uint8_t>(Out, IsSketch);
+    Append<uint64_t>(Out, Levels);
+    Append<uint64_t>(Out, Counts.size());
+    for(uint64_t Count : Counts) Append<uint64_t>(Out, Count);
+}
+void SampleStatistics::LoadState(const std::string& In, size_t& Pos){
+    /******* The matrix must have the shape set by Reset() *******/
+    bool tmpIsSketch = Extract<uint8_t>(In, Pos);
+    size_t tmpLevels = Extract<uint64_t>(In, Pos);
+    if(tmpIsSketch!=IsSketch || tmpLevels!=Levels || Extract<uint64_t>(In, Pos)!=Counts.size())
+        throw std::runtime_error("Sample statistics with different samples or limits can't be loaded");
+    for(uint64_t& Count : Counts) Count = Extract<uint64_t>(In, Pos);
+}
+void SampleStatistics::Accumulate(){
+    /*************
+        Each level becomes the number of values at or above it,
+        a suffix sum per histogram
+    *************/
+    for(size_t Row(0); Row < Counts.size(); Row += RowSize){
+        for(uint64_t* Histogram : {&Counts[Row], &Counts[Row+Levels]})
+            for(size_t i = Levels-1; i > 0; i--) Histogram[i-1] += Histogram[i];
+    }
+}
+uint64_t SampleStatistics::Depth(size_t Sample, int Level) const{
+    return Counts[Sample*RowSize+Level];
+}
+uint64_t SampleStatistics::Quality(size_t Sample, int Level) const{
+    return Counts[Sample*RowSize+Levels+Level];
+}
+uint64_t SampleStatistics::NonMissing(size_t Sample) const{
+    return Counts[Sample*RowSize+2*Levels];
+}
+double SampleStatistics::MeanDepth(size_t Sample) const{
+    return Mean(&Counts[Sample*RowSize], Counts[Sample*RowSize+2*Levels+1]);
+}
+double SampleStatistics::MeanQuality(size_t Sample) const{
+    return Mean(&Counts[Sample*RowSize+Levels], Counts[Sample*RowSize+2*Levels+2]);
+}
+double SampleStatistics::Mean(const uint64_t* Histogram, uint64_t Sum) const{
+    uint64_t Total = 0;
+    for(size_t i(1); i < Levels; i++) Total += Histogram[i];
+    return static_cast<double>(Sum)/Total;
+}
+int SampleStatistics::DepthPercentile(size_t Sample, double Rank) const{
+    return Percentile(&Counts[Sample*RowSize], Rank);
+}
+int SampleStatistics::QualityPercentile(size_t Sample, double Rank) const{
+    return Percentile(&Counts[Sample*RowSize+Levels], Rank);
+}
+int SampleStatistics::Percentile(const uint64_t* Histogram, double Rank) const{
+    /*************
+        Smallest level holding at least Rank of the values above 0,
+        -1 when there are none
+    *************/
+    uint64_t Total = 0;
+    for(size_t i(1); i < Levels; i++) Total += Histogram[i];
+    if(Total==0) return -1;
+    uint64_t Target = std::max<uint64_t>(1, std::ceil(Rank*Total));
+    uint64_t Count = 0;
+    for(size_t i(1); i < Levels; i++){
+        Count += Histogram[i];
+        if(Count >= Target) return LevelValue(i);
+    }
+    return LevelValue(Levels-1);
+}
+int SampleStatistics::LevelValue(size_t Level) const{
+    /*************
+        Sketch levels report the middle of their range
+    *************/
+    if(!IsSketch || Level < 16) return Level;
+    int Exponent = 4 + (Level-16)/8;
+    int64_t Low = int64_t(8 + (Level-16)%8) << (Exponent-3);
+    int64_t Width = int64_t(1) << (Exponent-3);
+    return Low + Width/2;
+}
+size_t SampleStatistics::Samples() const{
+    return RowSize ? Counts.size()/RowSize : 0;
+}
+int SampleStatistics::Limit() const{
+    return Levels-1;
+}
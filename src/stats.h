@@ -0,0 +1,65 @@
+#ifndef STATS_H
+#define STATS_H
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+/*************
+    Depth and quality histograms of every sample in one matrix. Row k
+    holds Depth[0..Levels), Quality[0..Levels), the non-missing count
+    and the DP/GQ sums of sample k. Matrices of the same shape are
+    merged by adding them, so threads (or runs over different
+    chromosomes) keep their own copy.
+    By default level i counts value i and values above Limit fall in
+    the last level. As a sketch, levels are log-linear (HDR-style):
+    values below 16 have their own level and every power of two above
+    is split in 8, so any int fits in 232 levels within 1/16 of its
+    value.
+*************/
+class SampleStatistics
+{
+public:
+    SampleStatistics(size_t Samples = 0, int Limit = 100, bool IsSketch = false);
+    static const int SketchLevels = 232;
+    void Reset(size_t Samples, int Limit, bool IsSketch = false);
+    void Add(size_t Sample, int Depth, int Quality){
+        uint64_t* Row = &Counts[Sample*RowSize];
+        Row[Level(Depth)]++;
+        Row[Levels+Level(Quality)]++;
+        if(Depth > 0){
+            Row[2*Levels]++;
+            Row[2*Levels+1] += Depth;
+        }
+        if(Quality > 0) Row[2*Levels+2] += Quality;
+    }
+    void Merge(const SampleStatistics& Other);
+    void Accumulate();
+    uint64_t Depth(size_t Sample, int Level) const;
+    uint64_t Quality(size_t Sample, int Level) const;
+    uint64_t NonMissing(size_t Sample) const;
+    double MeanDepth(size_t Sample) const;
+    double MeanQuality(size_t Sample) const;
+    int DepthPercentile(size_t Sample, double Rank) const;
+    int QualityPercentile(size_t Sample, double Rank) const;
+    size_t Samples() const;
+    int Limit() const;
+    void SaveState(std::string& Out) const;
+    void LoadState(const std::string& In, size_t& Pos);
+private:
+    size_t Level(int Value) const{
+        if(Value <= 0) return 0;
+        if(IsSketch){
+            if(Value < 16) return Value;
+            int Exponent = 31 - __builtin_clz(Value);
+            return 16 + (Exponent-4)*8 + ((Value >> (Exponent-3)) & 7);
+        }
+        return size_t(Value) < Levels ? size_t(Value) : Levels-1;
+    }
+    int LevelValue(size_t Level) const;
+    int Percentile(const uint64_t* Histogram, double Rank) const;
+    double Mean(const uint64_t* Histogram, uint64_t Sum) const;
+    bool IsSketch = false;
+    size_t Levels = 0, RowSize = 0;
+    std::vector<uint64_t> Counts;
+};
+#endif